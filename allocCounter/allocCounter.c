@@ -0,0 +1,71 @@
+#include "allocCounter.h"
+
+#include <stddef.h>
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+static _Thread_local uint64_t allocation_count = 0;
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+/**
+ * Replaces malloc() when linked with --wrap=malloc
+ * 
+ * @param size 
+ */
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+
+    allocation_count += (ptr != NULL);
+    return ptr;
+}
+
+/**
+ * Replaces calloc() when linked with --wrap=calloc
+ * 
+ * @param count 
+ * @param size 
+ */
+void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __real_calloc(count, size);
+
+    allocation_count += (ptr != NULL);
+    return ptr;
+}
+
+/**
+ * Replaces realloc() when linked with --wrap=realloc
+ * 
+ * @param ptr 
+ * @param size 
+ */
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    void *new_ptr = __real_realloc(ptr, size);
+
+    allocation_count += (new_ptr != NULL);
+    return new_ptr;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Get the number of successful malloc, calloc and realloc calls made by the calling thread since it started.
+ * Read it before and after the code to measure.
+ */
+uint64_t allocCounter_getCount(void)
+{
+    return allocation_count;
+}
@@ -0,0 +1,20 @@
+/**
+ * @file allocCounter.h
+ * @author Kezia Marcou
+ * @brief Count of the heap allocations made by the calling thread.
+ * malloc, calloc and realloc are wrapped at link time, so every module is counted without knowing about it.
+ * Only successful calls are counted.
+ * 
+ * Dependencies :
+ * - link with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * 
+ */
+
+#ifndef INC_ALLOCCOUNTER_H
+#define INC_ALLOCCOUNTER_H
+
+#include <stdint.h>
+
+uint64_t allocCounter_getCount(void);
+
+#endif /* INC_ALLOCCOUNTER_H */
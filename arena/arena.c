@@ -0,0 +1,140 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+#define ALIGNMENT (sizeof(max_align_t))
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+/**
+ * Allocate a new empty block
+ * 
+ * @param capacity 
+ */
+ArenaBlock_t *private_newBlock(size_t capacity)
+{
+    ArenaBlock_t *block_ptr = malloc(sizeof *block_ptr + capacity);
+
+    if (block_ptr != NULL)
+    {
+        block_ptr->next = NULL;
+        block_ptr->capacity = capacity;
+        block_ptr->used = 0;
+    }
+
+    return block_ptr;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Initialize an arena with a first block. Returns false if it could not be allocated.
+ * 
+ * @param arena_ptr 
+ * @param block_size capacity of the blocks of the arena
+ */
+bool arena_init(Arena_t *arena_ptr, size_t block_size)
+{
+    arena_ptr->block_size = block_size;
+    arena_ptr->first = private_newBlock(block_size);
+    arena_ptr->current = arena_ptr->first;
+
+    return arena_ptr->first != NULL;
+}
+
+/**
+ * Free an arena and all the memory allocated from it
+ * 
+ * @param arena_ptr 
+ */
+void arena_deInit(Arena_t *arena_ptr)
+{
+    ArenaBlock_t *block_ptr = arena_ptr->first;
+
+    while (block_ptr != NULL)
+    {
+        ArenaBlock_t *next_ptr = block_ptr->next;
+        free(block_ptr);
+        block_ptr = next_ptr;
+    }
+
+    arena_ptr->first = NULL;
+    arena_ptr->current = NULL;
+}
+
+/**
+ * Allocate memory from an arena, aligned for any type. Returns NULL if a new block was needed and could not be allocated.
+ * The memory stays valid until the arena is reset (or restored to a mark taken before this allocation).
+ * 
+ * @param arena_ptr 
+ * @param size 
+ */
+void *arena_alloc(Arena_t *arena_ptr, size_t size)
+{
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    // Use the next blocks (kept from before the last reset) or add one, until one has room
+    while (arena_ptr->current->capacity - arena_ptr->current->used < size)
+    {
+        if (arena_ptr->current->next == NULL)
+        {
+            size_t capacity = (size > arena_ptr->block_size) ? size : arena_ptr->block_size;
+            arena_ptr->current->next = private_newBlock(capacity);
+
+            if (arena_ptr->current->next == NULL)
+            {
+                return NULL;
+            }
+        }
+
+        arena_ptr->current = arena_ptr->current->next;
+        arena_ptr->current->used = 0;
+    }
+
+    void *memory_ptr = (uint8_t *) arena_ptr->current->data + arena_ptr->current->used;
+    arena_ptr->current->used += size;
+
+    return memory_ptr;
+}
+
+/**
+ * Free everything allocated from an arena at once. Its blocks are kept for the next allocations.
+ * 
+ * @param arena_ptr 
+ */
+void arena_reset(Arena_t *arena_ptr)
+{
+    arena_ptr->current = arena_ptr->first;
+    arena_ptr->first->used = 0;
+}
+
+/**
+ * Get the current position of an arena
+ * 
+ * @param arena_ptr 
+ */
+ArenaMark_t arena_getMark(const Arena_t *arena_ptr)
+{
+    return (ArenaMark_t) {arena_ptr->current, arena_ptr->current->used};
+}
+
+/**
+ * Free everything allocated from an arena since a mark was taken
+ * 
+ * @param arena_ptr 
+ * @param mark 
+ */
+void arena_restore(Arena_t *arena_ptr, ArenaMark_t mark)
+{
+    arena_ptr->current = mark.block;
+    arena_ptr->current->used = mark.used;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file arena.h
+ * @author Kezia Marcou
+ * @brief Bump allocator for short-lived scratch memory.
+ * Allocations are never freed one by one : the whole arena is reset at once, keeping its memory for the next use.
+ * Once an arena has grown to the size a workload needs, allocating from it makes no heap call.
+ * 
+ */
+
+#ifndef INC_ARENA_H
+#define INC_ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*---Structs---*/
+
+typedef struct ArenaBlock_s
+{
+    struct ArenaBlock_s *next;
+    size_t capacity;    // usable bytes in data
+    size_t used;
+    max_align_t data[]; // max_align_t so that every allocation is suitably aligned
+} ArenaBlock_t;
+
+typedef struct
+{
+    ArenaBlock_t *first;
+    ArenaBlock_t *current; // block allocations are taken from, the following blocks are unused
+    size_t block_size;     // capacity of new blocks (bigger for allocations that do not fit)
+} Arena_t;
+
+/// Position in an arena, to free everything allocated after it with arena_restore()
+typedef struct
+{
+    ArenaBlock_t *block;
+    size_t used;
+} ArenaMark_t;
+
+bool arena_init(Arena_t *arena_ptr, size_t block_size);
+void arena_deInit(Arena_t *arena_ptr);
+
+void *arena_alloc(Arena_t *arena_ptr, size_t size);
+void arena_reset(Arena_t *arena_ptr);
+
+ArenaMark_t arena_getMark(const Arena_t *arena_ptr);
+void arena_restore(Arena_t *arena_ptr, ArenaMark_t mark);
+
+#endif /* INC_ARENA_H */
@@ -0,0 +1,770 @@
+/**
+ * @file bench.c
+ * @author Kezia Marcou
+ * @brief Benchmark suite of the diceRoller layers : parsing, evaluation, RNG functions, dice pools, whole rolls and output formatting.
+ * Prints one tab-separated line per benchmark (name, ns/op, ops/s, allocations/op), and compares the results
+ * with a baseline file written on the same machine, adding the time difference to each line.
+ * Timings are noisy, so regressions only make the run fail with --strict : a benchmark slower than its baseline
+ * by more than the tolerance, or allocating more.
+ * Before timing anything, checks that results drawn from an alias table have the same mean as the evaluator, and fails otherwise.
+ * 
+ * Built and run by make bench. Heap allocations are counted by allocCounter.
+ * 
+ */
+
+/*---Arguments---*/
+#define OPTIONAL_ARGS \
+        OPTIONAL_STRING_ARG(baseline, "", "--baseline", "file", "Compare the results with this baseline file") \
+        OPTIONAL_STRING_ARG(write_baseline, "", "--write-baseline", "file", "Write the results to this baseline file") \
+        OPTIONAL_DOUBLE_ARG(tolerance, 0.3, "--tolerance", "ratio", "Slowdown allowed before a benchmark fails", 2) \
+        OPTIONAL_STRING_ARG(filter, "", "--filter", "text", "Only run the benchmarks whose name contains text")
+
+#define BOOLEAN_ARGS \
+        BOOLEAN_ARG(help, "-h", "Show help") \
+        BOOLEAN_ARG(strict, "--strict", "Fail if a benchmark is slower than its baseline by more than the tolerance, or allocates more")
+
+#define _GNU_SOURCE // clock_gettime
+
+#include "easyargs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include "allocCounter.h"
+#include "simpleRNG.h"
+#include "arena.h"
+#include "parsedElements.h"
+#include "formulaParser.h"
+#include "formulaCache.h"
+#include "diceDistribution.h"
+#include "aliasTable.h"
+#include "outputWriter.h"
+
+/*******************************************
+ * Macros, structs, variables
+ */
+
+#define MIN_RUN_TIME_NS 50000000ULL // every measure runs at least this long
+#define RUN_COUNT 5                 // the best of this many measures is kept
+#define MAX_BENCHMARK_COUNT 64
+#define NAME_SIZE 64
+#define FILL_BATCH_SIZE 256
+
+#define FORMULA "1d20+7+(2d6+3)*2"
+
+#define CHECK_FORMULA "1d20+1d20"       // advantage and disadvantage apply to different dice
+#define CHECK_SAMPLE_COUNT 400000
+#define CHECK_MAX_DEVIATION 5.0         // standard errors allowed between the alias table and evaluator means
+
+typedef struct
+{
+    const char *name;
+    uint64_t (*function)(uint64_t iteration_count); // returns a checksum, so that the work cannot be optimized away
+} Benchmark_t;
+
+typedef struct
+{
+    char name[NAME_SIZE];
+    double ns_per_op;
+    double allocations_per_op;
+} BenchmarkResult_t;
+
+static volatile uint64_t checksum_sink = 0;
+
+static simpleRNG_state_t rng;
+static CompiledFormula_t compiled_formula;
+static CompiledFormula_t small_pool;
+static CompiledFormula_t large_pool;
+static CompiledFormula_t huge_pool;
+static FormulaCache_t formula_cache;
+static AliasTable_t alias_table;
+static Arena_t arena;
+
+// Private function of formulaParser.c, benchmarked on its own
+ParsedElementError_t private_tokenizeFormula(char *formula, ParsedElementArray_t *element_array_ptr);
+
+/*******************************************
+ * Benchmarks
+ */
+
+uint64_t benchTokenize(uint64_t iteration_count)
+{
+    char formula[] = FORMULA;
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        ParsedElementArray_t elements;
+        parsedElements_arrayInitInArena(&elements, &arena);
+        private_tokenizeFormula(formula, &elements);
+        checksum += elements.current_length;
+        arena_reset(&arena);
+    }
+
+    return checksum;
+}
+
+uint64_t benchCompile(uint64_t iteration_count)
+{
+    char formula[] = FORMULA;
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        CompiledFormula_t compiled;
+        formulaParser_compile(formula, &compiled);
+        checksum += compiled.bytecode_length;
+        formulaParser_deInit(&compiled);
+    }
+
+    return checksum;
+}
+
+uint64_t benchCompileInArena(uint64_t iteration_count)
+{
+    char formula[] = FORMULA;
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        CompiledFormula_t compiled;
+        formulaParser_compileInArena(formula, &compiled, &arena);
+        checksum += compiled.bytecode_length;
+        arena_reset(&arena);
+    }
+
+    return checksum;
+}
+
+uint64_t benchEvaluate(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        int32_t result = 0;
+        formulaParser_evaluate(&compiled_formula, &rng, FORMULA_FLAG_NONE, &result);
+        checksum += result;
+    }
+
+    return checksum;
+}
+
+uint64_t benchEvaluateAdvantage(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        int32_t result = 0;
+        formulaParser_evaluate(&compiled_formula, &rng, FORMULA_FLAG_ADVANTAGE, &result);
+        checksum += result;
+    }
+
+    return checksum;
+}
+
+uint64_t benchCalculateFormula(uint64_t iteration_count)
+{
+    char formula[] = FORMULA;
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        checksum += formulaParser_calculateFormula(formula, false, false, false, NULL, NULL);
+    }
+
+    return checksum;
+}
+
+uint64_t benchCachedRoll(uint64_t iteration_count)
+{
+    static const char *formulas[] = {"1d20+7", "2d6+4", "1d8+1d6+3", "4d6"};
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        const CompiledFormula_t *compiled_ptr;
+        formulaCache_get(&formula_cache, formulas[i & 3], &compiled_ptr);
+        int32_t result = 0;
+        formulaParser_evaluate(compiled_ptr, &rng, FORMULA_FLAG_NONE, &result);
+        checksum += result;
+    }
+
+    return checksum;
+}
+
+uint64_t benchSmallPool(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        int32_t result = 0;
+        formulaParser_evaluate(&small_pool, &rng, FORMULA_FLAG_NONE, &result);
+        checksum += result;
+    }
+
+    return checksum;
+}
+
+uint64_t benchLargePool(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        int32_t result = 0;
+        formulaParser_evaluate(&large_pool, &rng, FORMULA_FLAG_NONE, &result);
+        checksum += result;
+    }
+
+    return checksum;
+}
+
+uint64_t benchHugePool(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        int32_t result = 0;
+        formulaParser_evaluate(&huge_pool, &rng, FORMULA_FLAG_NONE, &result);
+        checksum += result;
+    }
+
+    return checksum;
+}
+
+uint64_t benchAliasDraw(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        checksum += aliasTable_draw(&alias_table, &rng);
+    }
+
+    return checksum;
+}
+
+uint64_t benchRandomUint64(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint64_r(&rng);}
+    return checksum;
+}
+
+uint64_t benchRandomUint32(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint32_r(&rng);}
+    return checksum;
+}
+
+uint64_t benchRandomUint8(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint8_r(&rng);}
+    return checksum;
+}
+
+uint64_t benchUint64InRange(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint64InRange_r(&rng, 1, 1000000007);}
+    return checksum;
+}
+
+uint64_t benchUint32InRange(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint32InRange_r(&rng, 1, 20);}
+    return checksum;
+}
+
+uint64_t benchUint8InRange(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint8InRange_r(&rng, 1, 6);}
+    return checksum;
+}
+
+uint64_t benchInt64InRange(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomInt64InRange_r(&rng, -1000, 1000);}
+    return checksum;
+}
+
+uint64_t benchInt32InRange(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomInt32InRange_r(&rng, -1000, 1000);}
+    return checksum;
+}
+
+uint64_t benchInt8InRange(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomInt8InRange_r(&rng, -100, 100);}
+    return checksum;
+}
+
+uint64_t benchRandomDouble(uint64_t iteration_count)
+{
+    double checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomDouble_r(&rng);}
+    return (uint64_t) checksum;
+}
+
+uint64_t benchFillUint32InRange(uint64_t iteration_count)
+{
+    uint32_t buffer[FILL_BATCH_SIZE];
+    uint64_t checksum = 0;
+
+    // One operation is one value
+    for (uint64_t i = 0; i < iteration_count; i += FILL_BATCH_SIZE)
+    {
+        simpleRNG_fillUint32InRange_r(&rng, buffer, FILL_BATCH_SIZE, 1, 6);
+        checksum += buffer[i & (FILL_BATCH_SIZE - 1)];
+    }
+
+    return checksum;
+}
+
+uint64_t benchBinomial(uint64_t iteration_count)
+{
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomBinomial_r(&rng, 1000000, 1.0 / 6.0);}
+    return checksum;
+}
+
+uint64_t benchXoshiro(uint64_t iteration_count)
+{
+    simpleRNG_state_t state;
+    uint64_t checksum = 0;
+
+    simpleRNG_initBackend_r(&state, SIMPLERNG_BACKEND_XOSHIRO256SS, 1);
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint64_r(&state);}
+    return checksum;
+}
+
+uint64_t benchFormatInt32(uint64_t iteration_count)
+{
+    char buffer[OUTPUT_WRITER_INT32_MAX_LENGTH];
+    uint64_t checksum = 0;
+
+    // Results of a typical batch : a few digits, sometimes negative
+    for (uint64_t i = 0; i < iteration_count; i++)
+    {
+        checksum += outputWriter_formatInt32(simpleRNG_randomInt32InRange_r(&rng, -20, 200), buffer) + buffer[0];
+    }
+
+    return checksum;
+}
+
+uint64_t benchPcg(uint64_t iteration_count)
+{
+    simpleRNG_state_t state;
+    uint64_t checksum = 0;
+
+    simpleRNG_initBackend_r(&state, SIMPLERNG_BACKEND_PCG64, 1);
+    for (uint64_t i = 0; i < iteration_count; i++) {checksum += simpleRNG_randomUint64_r(&state);}
+    return checksum;
+}
+
+static const Benchmark_t benchmarks[] = {
+    {"parse/tokenize", benchTokenize},
+    {"parse/compile", benchCompile},
+    {"parse/compile_arena", benchCompileInArena},
+    {"eval/bytecode", benchEvaluate},
+    {"eval/bytecode_advantage", benchEvaluateAdvantage},
+    {"roll/calculate_formula", benchCalculateFormula},
+    {"roll/cached", benchCachedRoll},
+    {"roll/alias_table", benchAliasDraw},
+    {"pool/4d6", benchSmallPool},
+    {"pool/1000d6", benchLargePool},
+    {"pool/1000000d6", benchHugePool},
+    {"rng/uint64", benchRandomUint64},
+    {"rng/uint32", benchRandomUint32},
+    {"rng/uint8", benchRandomUint8},
+    {"rng/uint64_in_range", benchUint64InRange},
+    {"rng/uint32_in_range", benchUint32InRange},
+    {"rng/uint8_in_range", benchUint8InRange},
+    {"rng/int64_in_range", benchInt64InRange},
+    {"rng/int32_in_range", benchInt32InRange},
+    {"rng/int8_in_range", benchInt8InRange},
+    {"rng/double", benchRandomDouble},
+    {"rng/fill_uint32_in_range", benchFillUint32InRange},
+    {"rng/binomial", benchBinomial},
+    {"rng/xoshiro256ss_uint64", benchXoshiro},
+    {"rng/pcg64_uint64", benchPcg},
+    {"output/format_int32", benchFormatInt32}
+};
+
+/*******************************************
+ * Function prototypes
+ */
+
+uint64_t getTimeNs();
+bool setUp();
+bool checkAliasMean();
+void tearDown();
+BenchmarkResult_t runBenchmark(const Benchmark_t *benchmark_ptr);
+uint32_t readBaseline(const char *path, BenchmarkResult_t *baseline);
+const BenchmarkResult_t *findBaseline(const char *name, const BenchmarkResult_t *baseline, uint32_t baseline_count);
+bool compareWithBaseline(const BenchmarkResult_t *result_ptr, const BenchmarkResult_t *baseline_ptr, double tolerance);
+
+/********************************************
+ * Main
+ */
+
+int main(int argc, char *argv[])
+{
+    args_t args = make_default_args();
+    BenchmarkResult_t results[MAX_BENCHMARK_COUNT];
+    BenchmarkResult_t baseline[MAX_BENCHMARK_COUNT];
+    uint32_t result_count = 0;
+    uint32_t baseline_count = 0;
+    bool is_passing = true;
+
+    if (!parse_args(argc, argv, &args) || args.help)
+    {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    if ((args.baseline[0] != '\0') && ((baseline_count = readBaseline(args.baseline, baseline)) == 0))
+    {
+        fprintf(stderr, "Could not read the baseline file %s\n", args.baseline);
+        return 1;
+    }
+
+    if (!setUp())
+    {
+        fprintf(stderr, "Could not set up the benchmarks\n");
+        return 1;
+    }
+
+    if (!checkAliasMean())
+    {
+        tearDown();
+        return 1;
+    }
+
+    printf("name\tns_per_op\tops_per_sec\tallocs_per_op%s\n", (baseline_count != 0) ? "\tvs_baseline" : "");
+
+    for (uint32_t i = 0; i < sizeof benchmarks / sizeof *benchmarks; i++)
+    {
+        if ((args.filter[0] != '\0') && (strstr(benchmarks[i].name, args.filter) == NULL))
+        {
+            continue;
+        }
+
+        results[result_count] = runBenchmark(&benchmarks[i]);
+        const BenchmarkResult_t *baseline_ptr = findBaseline(results[result_count].name, baseline, baseline_count);
+
+        printf("%s\t%.2f\t%.0f\t%.4f", results[result_count].name, results[result_count].ns_per_op,
+            1e9 / results[result_count].ns_per_op, results[result_count].allocations_per_op);
+        if (baseline_ptr != NULL)
+        {
+            printf("\t%+.1f%%", (results[result_count].ns_per_op / baseline_ptr->ns_per_op - 1.0) * 100.0);
+        }
+        else if (baseline_count != 0)
+        {
+            printf("\t-");
+        }
+        printf("\n");
+        fflush(stdout);
+
+        if (baseline_ptr != NULL)
+        {
+            is_passing &= compareWithBaseline(&results[result_count], baseline_ptr, args.tolerance);
+        }
+
+        result_count++;
+    }
+
+    tearDown();
+
+    if (args.write_baseline[0] != '\0')
+    {
+        FILE *file = fopen(args.write_baseline, "w");
+        if (file == NULL)
+        {
+            perror(args.write_baseline);
+            return 1;
+        }
+
+        fprintf(file, "name\tns_per_op\tops_per_sec\tallocs_per_op\n");
+        for (uint32_t i = 0; i < result_count; i++)
+        {
+            fprintf(file, "%s\t%.2f\t%.0f\t%.4f\n", results[i].name, results[i].ns_per_op, 1e9 / results[i].ns_per_op, results[i].allocations_per_op);
+        }
+        fclose(file);
+    }
+
+    if (!is_passing)
+    {
+        fprintf(stderr, "Benchmark regressions found (tolerance %.0f%%)%s\n", args.tolerance * 100.0, args.strict ? "" : ", ignored without --strict");
+        return args.strict ? 1 : 0;
+    }
+
+    return 0;
+}
+
+/********************************************************
+ * Functions
+ */
+
+uint64_t getTimeNs()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+/**
+ * Prepare the formulas, cache, alias table and arena shared by the benchmarks
+ */
+bool setUp()
+{
+    char formula[] = FORMULA;
+    char small_formula[] = "4d6";
+    char large_formula[] = "1000d6";
+    char huge_formula[] = "1000000d6";
+    char alias_formula[] = "2d6+1d8+4";
+    CompiledFormula_t alias_compiled;
+    DiceDistribution_t distribution;
+
+    simpleRNG_init_r(&rng, 1);
+
+    if ((formulaParser_compile(formula, &compiled_formula) != PELEM_OK)
+        || (formulaParser_compile(small_formula, &small_pool) != PELEM_OK)
+        || (formulaParser_compile(large_formula, &large_pool) != PELEM_OK)
+        || (formulaParser_compile(huge_formula, &huge_pool) != PELEM_OK)
+        || (formulaParser_compile(alias_formula, &alias_compiled) != PELEM_OK))
+    {
+        return false;
+    }
+
+    bool is_ready = (diceDistribution_fromFormula(&alias_compiled, FORMULA_FLAG_NONE, &distribution) == DDIST_OK);
+    formulaParser_deInit(&alias_compiled);
+
+    if (is_ready)
+    {
+        is_ready = (aliasTable_init(&alias_table, distribution) == DDIST_OK);
+        diceDistribution_deInit(&distribution);
+    }
+
+    return is_ready && (formulaCache_init(&formula_cache, 16) == PELEM_OK) && arena_init(&arena, 4096);
+}
+
+/**
+ * Check that results drawn from the alias table of a formula have the same mean as results of the evaluator,
+ * with advantage and disadvantage both pending. The sample means must be within CHECK_MAX_DEVIATION standard errors.
+ */
+bool checkAliasMean()
+{
+    char formula[] = CHECK_FORMULA;
+    uint32_t flags = FORMULA_FLAG_ADVANTAGE | FORMULA_FLAG_DISADVANTAGE;
+    CompiledFormula_t compiled;
+    DiceDistribution_t distribution;
+    AliasTable_t table;
+    simpleRNG_state_t check_rng;
+    double alias_sum = 0.0;
+    double evaluator_sum = 0.0;
+
+    if (formulaParser_compile(formula, &compiled) != PELEM_OK)
+    {
+        fprintf(stderr, "Could not compile %s\n", formula);
+        return false;
+    }
+
+    if (diceDistribution_fromFormula(&compiled, flags, &distribution) != DDIST_OK)
+    {
+        fprintf(stderr, "Could not calculate the distribution of %s\n", formula);
+        formulaParser_deInit(&compiled);
+        return false;
+    }
+
+    if (aliasTable_init(&table, distribution) != DDIST_OK)
+    {
+        fprintf(stderr, "Could not build the alias table of %s\n", formula);
+        diceDistribution_deInit(&distribution);
+        formulaParser_deInit(&compiled);
+        return false;
+    }
+
+    simpleRNG_init_r(&check_rng, 2);
+    bool is_evaluated = true;
+
+    for (uint32_t i = 0; (i < CHECK_SAMPLE_COUNT) && is_evaluated; i++)
+    {
+        int32_t result = 0;
+
+        is_evaluated = (formulaParser_evaluate(&compiled, &check_rng, flags, &result) == PELEM_OK);
+        evaluator_sum += result;
+        alias_sum += aliasTable_draw(&table, &check_rng);
+    }
+
+    double alias_mean = alias_sum / CHECK_SAMPLE_COUNT;
+    double evaluator_mean = evaluator_sum / CHECK_SAMPLE_COUNT;
+    double standard_error = diceDistribution_getStandardDeviation(distribution) * sqrt(2.0 / CHECK_SAMPLE_COUNT);
+    bool is_matching = is_evaluated && (fabs(alias_mean - evaluator_mean) <= CHECK_MAX_DEVIATION * standard_error);
+
+    if (!is_matching)
+    {
+        fprintf(stderr, "Alias table mean %.3f does not match the evaluator mean %.3f for %s with advantage and disadvantage\n",
+            alias_mean, evaluator_mean, formula);
+    }
+
+    aliasTable_deInit(&table);
+    diceDistribution_deInit(&distribution);
+    formulaParser_deInit(&compiled);
+    return is_matching;
+}
+
+void tearDown()
+{
+    formulaParser_deInit(&compiled_formula);
+    formulaParser_deInit(&small_pool);
+    formulaParser_deInit(&large_pool);
+    formulaParser_deInit(&huge_pool);
+    formulaCache_deInit(&formula_cache);
+    aliasTable_deInit(&alias_table);
+    arena_deInit(&arena);
+}
+
+/**
+ * Measure a benchmark : the iteration count is doubled until a run lasts long enough, then the fastest of
+ * RUN_COUNT runs of that size is kept. A first run warms up caches (and the formula cache).
+ * 
+ * @param benchmark_ptr 
+ */
+BenchmarkResult_t runBenchmark(const Benchmark_t *benchmark_ptr)
+{
+    BenchmarkResult_t result = {0};
+    uint64_t iteration_count = 1;
+    uint64_t elapsed;
+
+    checksum_sink += benchmark_ptr->function(1);
+
+    while (true)
+    {
+        uint64_t start = getTimeNs();
+        checksum_sink += benchmark_ptr->function(iteration_count);
+        elapsed = getTimeNs() - start;
+
+        if (elapsed >= MIN_RUN_TIME_NS / 4)
+        {
+            break;
+        }
+        iteration_count *= 2;
+    }
+
+    // Scale up to the full run time
+    iteration_count = (uint64_t) ((double) iteration_count * MIN_RUN_TIME_NS / elapsed) + 1;
+
+    double best_ns_per_op = 0;
+    for (uint32_t i = 0; i < RUN_COUNT; i++)
+    {
+        uint64_t allocations_before = allocCounter_getCount();
+        uint64_t start = getTimeNs();
+        checksum_sink += benchmark_ptr->function(iteration_count);
+        elapsed = getTimeNs() - start;
+
+        double ns_per_op = (double) elapsed / iteration_count;
+        if ((i == 0) || (ns_per_op < best_ns_per_op))
+        {
+            best_ns_per_op = ns_per_op;
+        }
+        result.allocations_per_op = (double) (allocCounter_getCount() - allocations_before) / iteration_count;
+    }
+
+    snprintf(result.name, NAME_SIZE, "%s", benchmark_ptr->name);
+    result.ns_per_op = best_ns_per_op;
+    return result;
+}
+
+/**
+ * Read a baseline file written with --write-baseline. Returns the number of benchmarks read (0 on error)
+ * 
+ * @param path 
+ * @param baseline 
+ */
+uint32_t readBaseline(const char *path, BenchmarkResult_t *baseline)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+    uint32_t count = 0;
+
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    while ((count < MAX_BENCHMARK_COUNT) && (fgets(line, sizeof line, file) != NULL))
+    {
+        double ops_per_sec;
+        if (sscanf(line, "%63s %lf %lf %lf", baseline[count].name, &baseline[count].ns_per_op, &ops_per_sec, &baseline[count].allocations_per_op) == 4)
+        {
+            count++;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+/**
+ * Find the baseline of a benchmark. Returns NULL if it has none.
+ * 
+ * @param name 
+ * @param baseline 
+ * @param baseline_count 
+ */
+const BenchmarkResult_t *findBaseline(const char *name, const BenchmarkResult_t *baseline, uint32_t baseline_count)
+{
+    for (uint32_t i = 0; i < baseline_count; i++)
+    {
+        if (!strcmp(baseline[i].name, name))
+        {
+            return &baseline[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Compare a result with its baseline, printing regressions on stderr
+ * 
+ * @param result_ptr 
+ * @param baseline_ptr 
+ * @param tolerance 
+ */
+bool compareWithBaseline(const BenchmarkResult_t *result_ptr, const BenchmarkResult_t *baseline_ptr, double tolerance)
+{
+    bool is_passing = true;
+
+    if (result_ptr->ns_per_op > baseline_ptr->ns_per_op * (1.0 + tolerance))
+    {
+        fprintf(stderr, "REGRESSION %s : %.2f ns/op, baseline %.2f ns/op (+%.0f%%)\n", result_ptr->name,
+            result_ptr->ns_per_op, baseline_ptr->ns_per_op, (result_ptr->ns_per_op / baseline_ptr->ns_per_op - 1.0) * 100.0);
+        is_passing = false;
+    }
+
+    // Allocation counts are exact : any increase is a regression
+    if (result_ptr->allocations_per_op > baseline_ptr->allocations_per_op + 1e-4)
+    {
+        fprintf(stderr, "REGRESSION %s : %.4f allocations/op, baseline %.4f\n", result_ptr->name,
+            result_ptr->allocations_per_op, baseline_ptr->allocations_per_op);
+        is_passing = false;
+    }
+
+    return is_passing;
+}
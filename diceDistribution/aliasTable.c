@@ -0,0 +1,151 @@
+#include "aliasTable.h"
+
+#include <stdlib.h>
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+#define FRACTION_SCALE 18446744073709551616.0 // 2^64
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+/**
+ * Scale a probability in [0, 1] to a 64 bit threshold
+ * 
+ * @param probability 
+ */
+uint64_t private_getThreshold(double probability)
+{
+    double scaled = probability * FRACTION_SCALE;
+    return (scaled >= FRACTION_SCALE) ? UINT64_MAX : (uint64_t) scaled;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Build the alias table of a distribution (Vose's method, O(length)).
+ * Every column holds 1 / length of the total probability, split between its own value and one alias value.
+ * 
+ * @param table_ptr uninitialized table, must be freed with aliasTable_deInit() on success
+ * @param distribution 
+ */
+DiceDistributionError_t aliasTable_init(AliasTable_t *table_ptr, DiceDistribution_t distribution)
+{
+    uint32_t length = distribution.length;
+
+    table_ptr->min_value = distribution.min_value;
+    table_ptr->length = length;
+    table_ptr->thresholds = malloc(length * (sizeof *(table_ptr->thresholds)));
+    table_ptr->aliases = malloc(length * (sizeof *(table_ptr->aliases)));
+
+    // Probabilities scaled so that a full column is 1, and the columns under (small) and over (large) 1
+    double *scaled = malloc(length * (sizeof *scaled));
+    uint32_t *small = malloc(length * (sizeof *small));
+    uint32_t *large = malloc(length * (sizeof *large));
+    uint32_t small_count = 0;
+    uint32_t large_count = 0;
+
+    if ((table_ptr->thresholds == NULL) || (table_ptr->aliases == NULL) || (scaled == NULL) || (small == NULL) || (large == NULL))
+    {
+        aliasTable_deInit(table_ptr);
+        free(scaled);
+        free(small);
+        free(large);
+        return DDIST_ERR_ALLOC;
+    }
+
+    // Normalize, in case rounding errors made the total slightly different from 1
+    double total = 0.0;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        total += distribution.probabilities[i];
+    }
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        scaled[i] = distribution.probabilities[i] * length / total;
+        table_ptr->aliases[i] = i;
+
+        if (scaled[i] < 1.0)
+        {
+            small[small_count] = i;
+            small_count++;
+        }
+        else
+        {
+            large[large_count] = i;
+            large_count++;
+        }
+    }
+
+    // Fill every small column with probability taken from a large one
+    while ((small_count != 0) && (large_count != 0))
+    {
+        uint32_t small_index = small[small_count - 1];
+        uint32_t large_index = large[large_count - 1];
+        small_count--;
+
+        table_ptr->thresholds[small_index] = private_getThreshold(scaled[small_index]);
+        table_ptr->aliases[small_index] = large_index;
+
+        scaled[large_index] -= 1.0 - scaled[small_index];
+        if (scaled[large_index] < 1.0)
+        {
+            large_count--;
+            small[small_count] = large_index;
+            small_count++;
+        }
+    }
+
+    // Columns left are full (up to rounding errors)
+    for (uint32_t i = 0; i < large_count; i++)
+    {
+        table_ptr->thresholds[large[i]] = UINT64_MAX;
+    }
+    for (uint32_t i = 0; i < small_count; i++)
+    {
+        table_ptr->thresholds[small[i]] = UINT64_MAX;
+    }
+
+    free(scaled);
+    free(small);
+    free(large);
+    return DDIST_OK;
+}
+
+/**
+ * De-initialize an alias table (free the memory)
+ * 
+ * @param table_ptr 
+ */
+void aliasTable_deInit(AliasTable_t *table_ptr)
+{
+    free(table_ptr->thresholds);
+    free(table_ptr->aliases);
+    table_ptr->thresholds = NULL;
+    table_ptr->aliases = NULL;
+    table_ptr->length = 0;
+}
+
+/**
+ * Draw a value from the distribution of an alias table.
+ * The high half of random * length picks the column, and its low half is a uniform fraction that picks
+ * between the column value and its alias : one random number per draw.
+ * 
+ * @param table_ptr 
+ * @param rng_ptr 
+ */
+int32_t aliasTable_draw(const AliasTable_t *table_ptr, simpleRNG_state_t *rng_ptr)
+{
+    unsigned __int128 product = (unsigned __int128) simpleRNG_randomUint64_r(rng_ptr) * table_ptr->length;
+    uint32_t column = (uint32_t) (product >> 64);
+    uint64_t fraction = (uint64_t) product;
+
+    uint32_t index = (fraction < table_ptr->thresholds[column]) ? column : table_ptr->aliases[column];
+    return (int32_t) (table_ptr->min_value + index);
+}
@@ -0,0 +1,31 @@
+/**
+ * @file aliasTable.h
+ * @author Kezia Marcou
+ * @brief Walker/Vose alias table, to draw results from a precomputed distribution in O(1) :
+ * one random number and one table lookup per draw, whatever the number of dice of the formula.
+ * 
+ */
+
+#ifndef INC_ALIASTABLE_H
+#define INC_ALIASTABLE_H
+
+#include <stdint.h>
+#include "diceDistribution.h"
+#include "simpleRNG.h"
+
+/*---Structs---*/
+
+typedef struct
+{
+    int64_t min_value;    // value of column 0
+    uint32_t length;      // number of columns
+    uint64_t *thresholds; // column i gives min_value + i if the random fraction (scaled to 2^64) is under thresholds[i]...
+    uint32_t *aliases;    // ...and min_value + aliases[i] otherwise
+} AliasTable_t;
+
+DiceDistributionError_t aliasTable_init(AliasTable_t *table_ptr, DiceDistribution_t distribution);
+void aliasTable_deInit(AliasTable_t *table_ptr);
+
+int32_t aliasTable_draw(const AliasTable_t *table_ptr, simpleRNG_state_t *rng_ptr);
+
+#endif /* INC_ALIASTABLE_H */
@@ -0,0 +1,641 @@
+#include "diceDistribution.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+#include <float.h>
+#include <complex.h>
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+#define PI 3.14159265358979323846 // M_PI is not part of the C standard
+
+#define FFT_MIN_LENGTH 64 // convolutions where one distribution is shorter than this are done directly
+#define DIRECT_DICE_GROUP_MAX_WORK (1UL << 22) // dice groups needing more operations than this are raised to a power using FFTs
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+/**
+ * Get the distribution of a single number
+ * 
+ * @param value 
+ * @param distribution_ptr uninitialized distribution
+ */
+DiceDistributionError_t private_constant(int64_t value, DiceDistribution_t *distribution_ptr)
+{
+    DiceDistributionError_t status = diceDistribution_init(distribution_ptr, value, 1);
+    if (status)
+    {
+        return status;
+    }
+
+    distribution_ptr->probabilities[0] = 1.0;
+    return DDIST_OK;
+}
+
+/**
+ * Fill the twiddle factors of a FFT, twiddles[k] = exp(-2 * pi * i * k / length).
+ * Every factor is calculated on its own, so that rounding errors do not build up along the table.
+ * 
+ * @param twiddles length / 2 factors
+ * @param length must be a power of 2
+ */
+void private_initTwiddles(double complex *twiddles, uint32_t length)
+{
+    for (uint32_t k = 0; k < length / 2; k++)
+    {
+        double angle = -2.0 * PI * k / length;
+        twiddles[k] = cos(angle) + I * sin(angle);
+    }
+}
+
+/**
+ * In-place iterative radix-2 Fast Fourier Transform
+ * 
+ * @param data 
+ * @param length must be a power of 2
+ * @param twiddles factors filled by private_initTwiddles() for this length
+ * @param inverse calculate the inverse transform (without dividing by length)
+ */
+void private_fft(double complex *data, uint32_t length, const double complex *twiddles, bool inverse)
+{
+    // Bit reversal permutation
+    for (uint32_t i = 1, j = 0; i < length; i++)
+    {
+        uint32_t bit = length >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j)
+        {
+            double complex temp = data[i];
+            data[i] = data[j];
+            data[j] = temp;
+        }
+    }
+
+    for (uint32_t half_size = 1; half_size < length; half_size <<= 1)
+    {
+        uint32_t stride = length / (2 * half_size); // exp(-pi * i * k / half_size) is twiddles[k * stride]
+
+        for (uint32_t start = 0; start < length; start += 2 * half_size)
+        {
+            for (uint32_t k = 0; k < half_size; k++)
+            {
+                double complex twiddle = inverse ? conj(twiddles[k * stride]) : twiddles[k * stride];
+                double complex even = data[start + k];
+                double complex odd = data[start + k + half_size] * twiddle;
+
+                data[start + k] = even + odd;
+                data[start + k + half_size] = even - odd;
+            }
+        }
+    }
+}
+
+/**
+ * Convolve two distributions using FFTs, in O(n log n).
+ * The result is approximate : every probability has an absolute rounding error of up to eps * log2(n) * |a| * |b| (L2 norms),
+ * so the probabilities within that error of 0 are set to 0.
+ * 
+ * @param a 
+ * @param b 
+ * @param is_subtraction calculate a - b instead of a + b
+ * @param result_ptr initialized distribution with a length of a.length + b.length - 1
+ */
+DiceDistributionError_t private_convolveFft(DiceDistribution_t a, DiceDistribution_t b, bool is_subtraction, DiceDistribution_t *result_ptr)
+{
+    uint32_t fft_length = 1;
+    while (fft_length < result_ptr->length)
+    {
+        fft_length <<= 1;
+    }
+
+    double complex *a_transform = calloc(fft_length, sizeof *a_transform);
+    double complex *b_transform = calloc(fft_length, sizeof *b_transform);
+    double complex *twiddles = malloc((fft_length / 2) * (sizeof *twiddles));
+    double a_squares = 0.0;
+    double b_squares = 0.0;
+
+    if ((a_transform == NULL) || (b_transform == NULL) || (twiddles == NULL))
+    {
+        free(a_transform);
+        free(b_transform);
+        free(twiddles);
+        return DDIST_ERR_ALLOC;
+    }
+
+    for (uint32_t i = 0; i < a.length; i++)
+    {
+        a_transform[i] = a.probabilities[i];
+        a_squares += a.probabilities[i] * a.probabilities[i];
+    }
+    for (uint32_t j = 0; j < b.length; j++)
+    {
+        // For a subtraction, the highest value of b gives the lowest result
+        b_transform[j] = b.probabilities[is_subtraction ? (b.length - 1 - j) : j];
+        b_squares += b.probabilities[j] * b.probabilities[j];
+    }
+
+    private_initTwiddles(twiddles, fft_length);
+    private_fft(a_transform, fft_length, twiddles, false);
+    private_fft(b_transform, fft_length, twiddles, false);
+
+    for (uint32_t i = 0; i < fft_length; i++)
+    {
+        a_transform[i] *= b_transform[i];
+    }
+
+    private_fft(a_transform, fft_length, twiddles, true);
+
+    // Negative values and values within the rounding error are noise
+    double rounding_error = DBL_EPSILON * log2(fft_length) * sqrt(a_squares * b_squares);
+    for (uint32_t i = 0; i < result_ptr->length; i++)
+    {
+        double probability = creal(a_transform[i]) / fft_length;
+        result_ptr->probabilities[i] = (probability > rounding_error) ? probability : 0.0;
+    }
+
+    free(a_transform);
+    free(b_transform);
+    free(twiddles);
+    return DDIST_OK;
+}
+
+/**
+ * Get the distribution of the sum (or difference) of two independent distributions.
+ * Long distributions are convolved using FFTs.
+ * 
+ * @param a 
+ * @param b 
+ * @param is_subtraction calculate a - b instead of a + b
+ * @param result_ptr uninitialized distribution
+ */
+DiceDistributionError_t private_convolve(DiceDistribution_t a, DiceDistribution_t b, bool is_subtraction, DiceDistribution_t *result_ptr)
+{
+    int64_t min_value = is_subtraction ? (a.min_value - (b.min_value + b.length - 1)) : (a.min_value + b.min_value);
+    
+    DiceDistributionError_t status = diceDistribution_init(result_ptr, min_value, (uint64_t) a.length + b.length - 1);
+    if (status)
+    {
+        return status;
+    }
+
+    if ((a.length >= FFT_MIN_LENGTH) && (b.length >= FFT_MIN_LENGTH))
+    {
+        status = private_convolveFft(a, b, is_subtraction, result_ptr);
+        if (status)
+        {
+            diceDistribution_deInit(result_ptr);
+        }
+        return status;
+    }
+
+    for (uint32_t i = 0; i < a.length; i++)
+    {
+        if (a.probabilities[i] == 0.0)
+        {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < b.length; j++)
+        {
+            // For a subtraction, the highest value of b gives the lowest result
+            uint32_t b_index = is_subtraction ? (b.length - 1 - j) : j;
+            result_ptr->probabilities[i + j] += a.probabilities[i] * b.probabilities[b_index];
+        }
+    }
+
+    return DDIST_OK;
+}
+
+/**
+ * Get the distribution of the product of two independent distributions
+ * 
+ * @param a 
+ * @param b 
+ * @param result_ptr uninitialized distribution
+ */
+DiceDistributionError_t private_multiply(DiceDistribution_t a, DiceDistribution_t b, DiceDistribution_t *result_ptr)
+{
+    int64_t a_bounds[2] = {a.min_value, a.min_value + a.length - 1};
+    int64_t b_bounds[2] = {b.min_value, b.min_value + b.length - 1};
+    int64_t min_value = INT64_MAX;
+    int64_t max_value = INT64_MIN;
+
+    // The extreme products are products of extreme values
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        for (uint32_t j = 0; j < 2; j++)
+        {
+            int64_t product;
+            if (__builtin_mul_overflow(a_bounds[i], b_bounds[j], &product))
+            {
+                return DDIST_ERR_TOO_LARGE;
+            }
+
+            min_value = (product < min_value) ? product : min_value;
+            max_value = (product > max_value) ? product : max_value;
+        }
+    }
+
+    DiceDistributionError_t status = diceDistribution_init(result_ptr, min_value, (uint64_t) (max_value - min_value) + 1);
+    if (status)
+    {
+        return status;
+    }
+
+    for (uint32_t i = 0; i < a.length; i++)
+    {
+        if (a.probabilities[i] == 0.0)
+        {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < b.length; j++)
+        {
+            int64_t product = (a.min_value + i) * (b.min_value + j);
+            result_ptr->probabilities[product - min_value] += a.probabilities[i] * b.probabilities[j];
+        }
+    }
+
+    return DDIST_OK;
+}
+
+/**
+ * Add a die to a distribution.
+ * Adding a uniform die is a sliding window sum, so it is done in O(length) instead of O(length * side_count).
+ * 
+ * @param distribution_ptr initialized distribution, replaced by the new one
+ * @param side_count 
+ */
+DiceDistributionError_t private_addDie(DiceDistribution_t *distribution_ptr, uint32_t side_count)
+{
+    DiceDistribution_t result;
+    DiceDistributionError_t status = diceDistribution_init(&result, distribution_ptr->min_value + 1, (uint64_t) distribution_ptr->length + side_count - 1);
+    if (status)
+    {
+        return status;
+    }
+
+    double window_sum = 0.0;
+
+    for (uint32_t i = 0; i < result.length; i++)
+    {
+        // Window is [i - side_count + 1, i] in the old distribution
+        if (i < distribution_ptr->length)
+        {
+            window_sum += distribution_ptr->probabilities[i];
+        }
+        if (i >= side_count)
+        {
+            window_sum -= distribution_ptr->probabilities[i - side_count];
+        }
+
+        // Rounding errors can make an empty window slightly negative
+        result.probabilities[i] = (window_sum > 0.0) ? (window_sum / side_count) : 0.0;
+    }
+
+    diceDistribution_deInit(distribution_ptr);
+    *distribution_ptr = result;
+    return DDIST_OK;
+}
+
+/**
+ * Add dice_count dice to a distribution.
+ * Small groups add one die at a time. Big groups raise the distribution of one die to the power dice_count
+ * by repeated squaring, so that only O(log dice_count) convolutions (done with FFTs) are needed.
+ * 
+ * @param distribution_ptr initialized distribution, replaced by the new one
+ * @param side_count 
+ * @param dice_count 
+ */
+DiceDistributionError_t private_addDice(DiceDistribution_t *distribution_ptr, uint32_t side_count, uint32_t dice_count)
+{
+    DiceDistributionError_t status = DDIST_OK;
+
+    if ((uint64_t) dice_count * dice_count * side_count <= DIRECT_DICE_GROUP_MAX_WORK)
+    {
+        for (uint32_t i = 0; (i < dice_count) && (status == DDIST_OK); i++)
+        {
+            status = private_addDie(distribution_ptr, side_count);
+        }
+        return status;
+    }
+
+    // Distribution of one die, squared at every step
+    DiceDistribution_t power;
+    status = diceDistribution_init(&power, 1, side_count);
+    if (status)
+    {
+        return status;
+    }
+
+    for (uint32_t k = 0; k < side_count; k++)
+    {
+        power.probabilities[k] = 1.0 / side_count;
+    }
+
+    while ((dice_count != 0) && (status == DDIST_OK))
+    {
+        DiceDistribution_t result;
+
+        if (dice_count & 1)
+        {
+            status = private_convolve(*distribution_ptr, power, false, &result);
+            if (status == DDIST_OK)
+            {
+                diceDistribution_deInit(distribution_ptr);
+                *distribution_ptr = result;
+            }
+        }
+
+        dice_count >>= 1;
+
+        if ((dice_count != 0) && (status == DDIST_OK))
+        {
+            status = private_convolve(power, power, false, &result);
+            if (status == DDIST_OK)
+            {
+                diceDistribution_deInit(&power);
+                power = result;
+            }
+        }
+    }
+
+    diceDistribution_deInit(&power);
+    return status;
+}
+
+/**
+ * Get the distribution of a d20 thrown with advantage (best of 2) or disadvantage (worst of 2)
+ * 
+ * @param is_advantage 
+ * @param distribution_ptr uninitialized distribution
+ */
+DiceDistributionError_t private_keptD20(bool is_advantage, DiceDistribution_t *distribution_ptr)
+{
+    DiceDistributionError_t status = diceDistribution_init(distribution_ptr, 1, 20);
+    if (status)
+    {
+        return status;
+    }
+
+    // The best (or worst) of 2 d20 gives k with probability (2k - 1) / 400 (or (41 - 2k) / 400)
+    for (uint32_t k = 1; k <= 20; k++)
+    {
+        uint32_t outcomes = is_advantage ? (2 * k - 1) : (2 * (20 - k) + 1);
+        distribution_ptr->probabilities[k - 1] = (double) outcomes / (20 * 20);
+    }
+
+    return DDIST_OK;
+}
+
+/**
+ * Get the distribution of a dice group, handling advantage/disadvantage on d20s
+ * 
+ * @param group TYPE_DICE_GROUP element
+ * @param is_advantage_ptr pending advantage, consumed by the first d20
+ * @param is_disadvantage_ptr pending disadvantage, consumed by the first d20 without advantage
+ * @param distribution_ptr uninitialized distribution
+ */
+DiceDistributionError_t private_diceGroup(ParsedElement_t group, bool *is_advantage_ptr, bool *is_disadvantage_ptr, DiceDistribution_t *distribution_ptr)
+{
+    uint32_t side_count = group.subtype;
+    uint32_t i = 0; // number of dice already in the distribution
+    DiceDistributionError_t status = private_constant(0, distribution_ptr);
+
+    if (status)
+    {
+        return status;
+    }
+
+    // Like the evaluator, advantage is consumed by the first d20 and disadvantage by the next one
+    while ((status == DDIST_OK) && (i < group.count) && (side_count == 20) && (*is_advantage_ptr || *is_disadvantage_ptr))
+    {
+        DiceDistribution_t kept_die;
+        DiceDistribution_t sum;
+
+        status = private_keptD20(*is_advantage_ptr, &kept_die);
+        if (status == DDIST_OK)
+        {
+            status = private_convolve(*distribution_ptr, kept_die, false, &sum);
+            diceDistribution_deInit(&kept_die);
+        }
+
+        if (status == DDIST_OK)
+        {
+            diceDistribution_deInit(distribution_ptr);
+            *distribution_ptr = sum;
+        }
+
+        if (*is_advantage_ptr) {*is_advantage_ptr = false;}
+        else {*is_disadvantage_ptr = false;}
+        i++;
+    }
+
+    if (status == DDIST_OK)
+    {
+        status = private_addDice(distribution_ptr, side_count, group.count - i);
+    }
+
+    if (status)
+    {
+        diceDistribution_deInit(distribution_ptr);
+    }
+
+    return status;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Initialize a distribution with every probability at 0 (allocate memory)
+ * 
+ * @param distribution_ptr 
+ * @param min_value value of the first probability
+ * @param length number of values, must not be more than DICE_DISTRIBUTION_MAX_LENGTH
+ */
+DiceDistributionError_t diceDistribution_init(DiceDistribution_t *distribution_ptr, int64_t min_value, uint64_t length)
+{
+    if (length > DICE_DISTRIBUTION_MAX_LENGTH)
+    {
+        return DDIST_ERR_TOO_LARGE;
+    }
+
+    distribution_ptr->probabilities = calloc(length, sizeof *(distribution_ptr->probabilities));
+    if (distribution_ptr->probabilities == NULL)
+    {
+        return DDIST_ERR_ALLOC;
+    }
+
+    distribution_ptr->min_value = min_value;
+    distribution_ptr->length = length;
+    return DDIST_OK;
+}
+
+/**
+ * De-initialize a distribution (free the memory)
+ * 
+ * @param distribution_ptr 
+ */
+void diceDistribution_deInit(DiceDistribution_t *distribution_ptr)
+{
+    free(distribution_ptr->probabilities);
+    distribution_ptr->probabilities = NULL;
+    distribution_ptr->length = 0;
+}
+
+/**
+ * Calculate the exact distribution of the result of a compiled formula
+ * 
+ * @param compiled_ptr formula compiled with formulaParser_compile()
+ * @param flags combination of FormulaFlag_t, only advantage and disadvantage are used
+ * @param distribution_ptr uninitialized distribution, must be freed with diceDistribution_deInit() on success
+ */
+DiceDistributionError_t diceDistribution_fromFormula(const CompiledFormula_t *compiled_ptr, uint32_t flags, DiceDistribution_t *distribution_ptr)
+{
+    bool is_advantage = (flags & FORMULA_FLAG_ADVANTAGE) != 0;
+    bool is_disadvantage = (flags & FORMULA_FLAG_DISADVANTAGE) != 0;
+    DiceDistributionError_t status = DDIST_OK;
+
+    // Same evaluation as formulaParser_evaluate(), with distributions instead of numbers
+    DiceDistribution_t *distribution_stack = malloc(compiled_ptr->stack_depth * (sizeof *distribution_stack));
+    uint32_t distribution_stack_size = 0;
+
+    if (distribution_stack == NULL)
+    {
+        return DDIST_ERR_ALLOC;
+    }
+
+    for (uint32_t i = 0; (i < compiled_ptr->postfix.current_length) && (status == DDIST_OK); i++)
+    {
+        ParsedElement_t element = compiled_ptr->postfix.array[i];
+
+        switch (element.type)
+        {
+        case TYPE_NUMBER:
+            status = private_constant(element.subtype, &distribution_stack[distribution_stack_size]);
+            break;
+
+        case TYPE_DICE_GROUP:
+            status = private_diceGroup(element, &is_advantage, &is_disadvantage, &distribution_stack[distribution_stack_size]);
+            break;
+
+        case TYPE_OPERATOR:
+        {
+            // The compiled formula was checked : there are always 2 distributions on the stack here
+            DiceDistribution_t a = distribution_stack[distribution_stack_size - 2];
+            DiceDistribution_t b = distribution_stack[distribution_stack_size - 1];
+            distribution_stack_size -= 2;
+
+            if (element.subtype == OPERATOR_TIMES)
+            {
+                status = private_multiply(a, b, &distribution_stack[distribution_stack_size]);
+            }
+            else
+            {
+                status = private_convolve(a, b, element.subtype == OPERATOR_MINUS, &distribution_stack[distribution_stack_size]);
+            }
+
+            diceDistribution_deInit(&a);
+            diceDistribution_deInit(&b);
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        if (status == DDIST_OK)
+        {
+            distribution_stack_size++;
+        }
+    }
+
+    if (status == DDIST_OK)
+    {
+        *distribution_ptr = distribution_stack[0];
+    }
+    else
+    {
+        for (uint32_t i = 0; i < distribution_stack_size; i++)
+        {
+            diceDistribution_deInit(&distribution_stack[i]);
+        }
+    }
+
+    free(distribution_stack);
+    return status;
+}
+
+/**
+ * Get the mean (expected value) of a distribution
+ * 
+ * @param distribution 
+ */
+double diceDistribution_getMean(DiceDistribution_t distribution)
+{
+    double mean = 0.0;
+
+    for (uint32_t i = 0; i < distribution.length; i++)
+    {
+        mean += distribution.probabilities[i] * (double) (distribution.min_value + i);
+    }
+
+    return mean;
+}
+
+/**
+ * Get the standard deviation of a distribution
+ * 
+ * @param distribution 
+ */
+double diceDistribution_getStandardDeviation(DiceDistribution_t distribution)
+{
+    double mean = diceDistribution_getMean(distribution);
+    double variance = 0.0;
+
+    for (uint32_t i = 0; i < distribution.length; i++)
+    {
+        double deviation = (double) (distribution.min_value + i) - mean;
+        variance += distribution.probabilities[i] * deviation * deviation;
+    }
+
+    return sqrt(variance);
+}
+
+/**
+ * Print every possible value of a distribution with its probability, followed by its mean and standard deviation
+ * 
+ * @param distribution 
+ * @param table_only only print the values and probabilities
+ */
+void diceDistribution_print(DiceDistribution_t distribution, bool table_only)
+{
+    if (!table_only) {printf("Value\tProbability\n");}
+
+    for (uint32_t i = 0; i < distribution.length; i++)
+    {
+        if (distribution.probabilities[i] > 0.0)
+        {
+            printf("%" PRId64 "\t%.12g\n", distribution.min_value + i, distribution.probabilities[i]);
+        }
+    }
+
+    if (!table_only)
+    {
+        printf("Mean: %f\n", diceDistribution_getMean(distribution));
+        printf("Standard deviation: %f\n", diceDistribution_getStandardDeviation(distribution));
+    }
+}
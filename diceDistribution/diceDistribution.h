@@ -0,0 +1,45 @@
+/**
+ * @file diceDistribution.h
+ * @author Kezia Marcou
+ * @brief Exact probability distribution of the result of a compiled formula.
+ * Distributions are calculated by convolving the distributions of the dice and numbers of the formula,
+ * following its postfix notation.
+ * 
+ */
+
+#ifndef INC_DICEDISTRIBUTION_H
+#define INC_DICEDISTRIBUTION_H
+
+#include <stdint.h>
+#include "formulaParser.h"
+
+/// Max number of values a distribution can have, to keep memory usage reasonable
+#define DICE_DISTRIBUTION_MAX_LENGTH (1UL << 24)
+
+typedef enum
+{
+    DDIST_OK,
+    DDIST_ERR_ALLOC,
+    DDIST_ERR_TOO_LARGE
+} DiceDistributionError_t;
+
+/*---Structs---*/
+
+typedef struct
+{
+    int64_t min_value;     // value whose probability is probabilities[0]
+    uint32_t length;       // number of values in the distribution
+    double *probabilities; // probabilities[i] is the probability of getting min_value + i
+} DiceDistribution_t;
+
+DiceDistributionError_t diceDistribution_init(DiceDistribution_t *distribution_ptr, int64_t min_value, uint64_t length);
+void diceDistribution_deInit(DiceDistribution_t *distribution_ptr);
+
+DiceDistributionError_t diceDistribution_fromFormula(const CompiledFormula_t *compiled_ptr, uint32_t flags, DiceDistribution_t *distribution_ptr);
+
+double diceDistribution_getMean(DiceDistribution_t distribution);
+double diceDistribution_getStandardDeviation(DiceDistribution_t distribution);
+
+void diceDistribution_print(DiceDistribution_t distribution, bool table_only);
+
+#endif /* INC_DICEDISTRIBUTION_H */
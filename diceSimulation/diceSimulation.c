@@ -0,0 +1,399 @@
+#include "diceSimulation.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include "simpleRNG.h"
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+#define HISTOGRAM_INITIAL_LENGTH 256 // values counted by a worker histogram before it first grows
+
+typedef struct
+{
+    const CompiledFormula_t *compiled_ptr;
+    uint32_t flags;
+    simpleRNG_state_t rng; // set to the start of the worker's own stream before starting the thread
+    pthread_t thread;
+    DiceSimulationResult_t result; // roll_count is set before starting the thread, the histogram only covers the results rolled
+    bool has_histogram;            // the formula bounds allow a histogram
+    int64_t min_value;             // formula bounds, the histogram never grows past them
+    int64_t max_value;
+    DiceSimulationError_t status;  // set if a roll could not be evaluated or the histogram could not grow, the worker then stops
+} SimulationWorker_t;
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+/**
+ * Grow the histogram of a result so that it counts a value, keeping its counts.
+ * The histogram at least doubles towards the value, within the bounds of the formula.
+ * 
+ * @param result_ptr 
+ * @param value 
+ * @param min_value lowest possible result, at most value
+ * @param max_value highest possible result, at least value
+ */
+DiceSimulationError_t private_growHistogram(DiceSimulationResult_t *result_ptr, int64_t value, int64_t min_value, int64_t max_value)
+{
+    int64_t new_min = value - HISTOGRAM_INITIAL_LENGTH / 2;
+    int64_t new_max = value + HISTOGRAM_INITIAL_LENGTH / 2;
+
+    if (result_ptr->histogram_length != 0)
+    {
+        int64_t old_max = result_ptr->histogram_min + result_ptr->histogram_length - 1;
+
+        new_min = (value < result_ptr->histogram_min) ? result_ptr->histogram_min - result_ptr->histogram_length : result_ptr->histogram_min;
+        new_max = (value > old_max) ? old_max + result_ptr->histogram_length : old_max;
+        new_min = (value < new_min) ? value : new_min;
+        new_max = (value > new_max) ? value : new_max;
+    }
+
+    new_min = (new_min < min_value) ? min_value : new_min;
+    new_max = (new_max > max_value) ? max_value : new_max;
+
+    uint64_t *histogram = calloc(new_max - new_min + 1, sizeof *histogram);
+    if (histogram == NULL)
+    {
+        return DSIM_ERR_ALLOC;
+    }
+
+    if (result_ptr->histogram_length != 0)
+    {
+        memcpy(&histogram[result_ptr->histogram_min - new_min], result_ptr->histogram, result_ptr->histogram_length * sizeof *histogram);
+    }
+
+    free(result_ptr->histogram);
+    result_ptr->histogram = histogram;
+    result_ptr->histogram_min = new_min;
+    result_ptr->histogram_length = new_max - new_min + 1;
+    return DSIM_OK;
+}
+
+/**
+ * Thread function : roll the formula the number of times given in the worker result.
+ * The workers are contiguous, so the statistics are accumulated in locals and written back once :
+ * updating them in place would make the threads fight over shared cache lines.
+ * The histogram starts empty and grows to cover the results rolled, which are usually far narrower than the formula bounds.
+ * 
+ * @param worker_void_ptr SimulationWorker_t
+ */
+void *private_runWorker(void *worker_void_ptr)
+{
+    SimulationWorker_t *worker_ptr = worker_void_ptr;
+    DiceSimulationResult_t *result_ptr = &worker_ptr->result;
+    simpleRNG_state_t rng = worker_ptr->rng;
+    const CompiledFormula_t *compiled_ptr = worker_ptr->compiled_ptr;
+    uint32_t flags = worker_ptr->flags;
+    uint64_t *histogram = result_ptr->histogram;
+    int64_t histogram_min = result_ptr->histogram_min;
+    uint32_t histogram_length = result_ptr->histogram_length;
+    uint64_t roll_count = result_ptr->roll_count;
+
+    int64_t sum = 0;
+    double sum_of_squares = 0.0;
+    int32_t min_result = INT32_MAX;
+    int32_t max_result = INT32_MIN;
+
+    for (uint64_t i = 0; i < roll_count; i++)
+    {
+        int32_t roll;
+        if (formulaParser_evaluate(compiled_ptr, &rng, flags, &roll) != PELEM_OK)
+        {
+            worker_ptr->status = DSIM_ERR_ALLOC;
+            break;
+        }
+
+        sum += roll;
+        sum_of_squares += (double) roll * roll;
+        min_result = (roll < min_result) ? roll : min_result;
+        max_result = (roll > max_result) ? roll : max_result;
+
+        uint64_t histogram_index = (uint64_t) (roll - histogram_min);
+        if ((histogram_index >= histogram_length) && worker_ptr->has_histogram)
+        {
+            worker_ptr->status = private_growHistogram(result_ptr, roll, worker_ptr->min_value, worker_ptr->max_value);
+            if (worker_ptr->status != DSIM_OK)
+            {
+                break;
+            }
+
+            histogram = result_ptr->histogram;
+            histogram_min = result_ptr->histogram_min;
+            histogram_length = result_ptr->histogram_length;
+            histogram_index = (uint64_t) (roll - histogram_min);
+        }
+
+        if (histogram_index < histogram_length)
+        {
+            histogram[histogram_index]++;
+        }
+    }
+
+    result_ptr->sum = sum;
+    result_ptr->sum_of_squares = sum_of_squares;
+    result_ptr->min_result = min_result;
+    result_ptr->max_result = max_result;
+    return NULL;
+}
+
+/**
+ * Initialize an empty result, without histogram
+ * 
+ * @param result_ptr 
+ */
+void private_initResult(DiceSimulationResult_t *result_ptr)
+{
+    result_ptr->roll_count = 0;
+    result_ptr->sum = 0;
+    result_ptr->sum_of_squares = 0.0;
+    result_ptr->min_result = INT32_MAX;
+    result_ptr->max_result = INT32_MIN;
+    result_ptr->histogram_min = 0;
+    result_ptr->histogram_length = 0;
+    result_ptr->histogram = NULL;
+}
+
+/**
+ * Add the histograms of every worker into the histogram of the simulation, which covers all of them (allocate memory)
+ * 
+ * @param workers 
+ * @param worker_count 
+ * @param result_ptr result without histogram
+ */
+DiceSimulationError_t private_mergeHistograms(const SimulationWorker_t *workers, uint32_t worker_count, DiceSimulationResult_t *result_ptr)
+{
+    int64_t merged_min = INT64_MAX;
+    int64_t merged_max = INT64_MIN;
+
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        const DiceSimulationResult_t *worker_result_ptr = &workers[i].result;
+
+        if (worker_result_ptr->histogram_length != 0)
+        {
+            int64_t worker_max = worker_result_ptr->histogram_min + worker_result_ptr->histogram_length - 1;
+
+            merged_min = (worker_result_ptr->histogram_min < merged_min) ? worker_result_ptr->histogram_min : merged_min;
+            merged_max = (worker_max > merged_max) ? worker_max : merged_max;
+        }
+    }
+
+    if (merged_min > merged_max)
+    {
+        return DSIM_OK;
+    }
+
+    result_ptr->histogram = calloc(merged_max - merged_min + 1, sizeof *(result_ptr->histogram));
+    if (result_ptr->histogram == NULL)
+    {
+        return DSIM_ERR_ALLOC;
+    }
+
+    result_ptr->histogram_min = merged_min;
+    result_ptr->histogram_length = merged_max - merged_min + 1;
+
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        const DiceSimulationResult_t *worker_result_ptr = &workers[i].result;
+        uint64_t *merged_ptr = &result_ptr->histogram[worker_result_ptr->histogram_min - merged_min];
+
+        for (uint32_t j = 0; j < worker_result_ptr->histogram_length; j++)
+        {
+            merged_ptr[j] += worker_result_ptr->histogram[j];
+        }
+    }
+
+    return DSIM_OK;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Roll a compiled formula roll_count times, split over thread_count threads, and merge the statistics of every roll.
+ * Only as many threads as rolls and RNG streams (see simpleRNG_getStreamCount_r()) are started.
+ * 
+ * @param compiled_ptr formula compiled with formulaParser_compile()
+ * @param flags combination of FormulaFlag_t. Steps are never printed.
+ * @param roll_count 
+ * @param thread_count number of threads, at least 1
+ * @param rng_ptr RNG of the simulation, each thread uses one of its next streams. Not modified.
+ * @param result_ptr uninitialized result, must be freed with diceSimulation_deInit() on success
+ */
+DiceSimulationError_t diceSimulation_run(const CompiledFormula_t *compiled_ptr, uint32_t flags, uint64_t roll_count, uint32_t thread_count, const simpleRNG_state_t *rng_ptr, DiceSimulationResult_t *result_ptr)
+{
+    DiceSimulationError_t status = DSIM_OK;
+    uint32_t started_count = 0;
+    int64_t min_value = 0;
+    int64_t max_value = 0;
+
+    // The first stream is the one of rng_ptr, the workers use the next ones
+    uint64_t max_thread_count = simpleRNG_getStreamCount_r(rng_ptr) - 1;
+    max_thread_count = (roll_count < max_thread_count) ? roll_count : max_thread_count;
+    thread_count = (thread_count > max_thread_count) ? (uint32_t) max_thread_count : thread_count;
+
+    if (thread_count == 0)
+    {
+        thread_count = 1;
+    }
+
+    bool has_histogram = formulaParser_getBounds(compiled_ptr, &min_value, &max_value)
+        && (max_value - min_value < (int64_t) DICE_SIMULATION_MAX_HISTOGRAM_LENGTH);
+
+    SimulationWorker_t *workers = calloc(thread_count, sizeof *workers);
+    if (workers == NULL)
+    {
+        return DSIM_ERR_ALLOC;
+    }
+
+    private_initResult(result_ptr);
+
+    for (uint32_t i = 0; (i < thread_count) && (status == DSIM_OK); i++)
+    {
+        workers[i].compiled_ptr = compiled_ptr;
+        workers[i].flags = flags & ~FORMULA_FLAG_PRINT_STEPS;
+        workers[i].has_histogram = has_histogram;
+        workers[i].min_value = min_value;
+        workers[i].max_value = max_value;
+
+        // Every worker gets the next stream of the RNG, so their numbers never overlap
+        workers[i].rng = (i == 0) ? *rng_ptr : workers[i - 1].rng;
+        simpleRNG_jumpStream_r(&workers[i].rng);
+
+        private_initResult(&workers[i].result);
+
+        // Split the rolls as evenly as possible
+        workers[i].result.roll_count = roll_count / thread_count + ((i < roll_count % thread_count) ? 1 : 0);
+
+        if (pthread_create(&workers[i].thread, NULL, private_runWorker, &workers[i]) != 0)
+        {
+            status = DSIM_ERR_THREAD;
+        }
+        else
+        {
+            started_count++;
+        }
+    }
+
+    // Merge the results of every thread
+    for (uint32_t i = 0; i < started_count; i++)
+    {
+        DiceSimulationResult_t *worker_result_ptr = &workers[i].result;
+
+        pthread_join(workers[i].thread, NULL);
+
+        if (workers[i].status != DSIM_OK)
+        {
+            status = workers[i].status;
+        }
+
+        result_ptr->roll_count += worker_result_ptr->roll_count;
+        result_ptr->sum += worker_result_ptr->sum;
+        result_ptr->sum_of_squares += worker_result_ptr->sum_of_squares;
+        result_ptr->min_result = (worker_result_ptr->min_result < result_ptr->min_result) ? worker_result_ptr->min_result : result_ptr->min_result;
+        result_ptr->max_result = (worker_result_ptr->max_result > result_ptr->max_result) ? worker_result_ptr->max_result : result_ptr->max_result;
+    }
+
+    if (status == DSIM_OK)
+    {
+        status = private_mergeHistograms(workers, started_count, result_ptr);
+    }
+
+    for (uint32_t i = 0; i < thread_count; i++)
+    {
+        diceSimulation_deInit(&workers[i].result);
+    }
+    free(workers);
+
+    if (status != DSIM_OK)
+    {
+        diceSimulation_deInit(result_ptr);
+    }
+
+    return status;
+}
+
+/**
+ * De-initialize a simulation result (free the memory)
+ * 
+ * @param result_ptr 
+ */
+void diceSimulation_deInit(DiceSimulationResult_t *result_ptr)
+{
+    free(result_ptr->histogram);
+    result_ptr->histogram = NULL;
+    result_ptr->histogram_length = 0;
+}
+
+/**
+ * Get the mean of the simulated rolls
+ * 
+ * @param result 
+ */
+double diceSimulation_getMean(DiceSimulationResult_t result)
+{
+    if (result.roll_count == 0)
+    {
+        return 0.0;
+    }
+
+    return (double) result.sum / result.roll_count;
+}
+
+/**
+ * Get the standard deviation of the simulated rolls
+ * 
+ * @param result 
+ */
+double diceSimulation_getStandardDeviation(DiceSimulationResult_t result)
+{
+    if (result.roll_count == 0)
+    {
+        return 0.0;
+    }
+
+    double mean = diceSimulation_getMean(result);
+    double variance = result.sum_of_squares / result.roll_count - mean * mean;
+
+    // Rounding errors can make a null variance slightly negative
+    return (variance > 0.0) ? sqrt(variance) : 0.0;
+}
+
+/**
+ * Print how many times every value was rolled, followed by the statistics of the simulation
+ * 
+ * @param result 
+ * @param table_only only print the values, counts and frequencies
+ */
+void diceSimulation_print(DiceSimulationResult_t result, bool table_only)
+{
+    if (!table_only && (result.histogram_length != 0)) {printf("Value\tCount\tFrequency\n");}
+
+    for (uint32_t i = 0; i < result.histogram_length; i++)
+    {
+        if (result.histogram[i] != 0)
+        {
+            printf("%" PRId64 "\t%" PRIu64 "\t%.12g\n", result.histogram_min + i, result.histogram[i], (double) result.histogram[i] / result.roll_count);
+        }
+    }
+
+    if (!table_only)
+    {
+        printf("Rolls: %" PRIu64 "\n", result.roll_count);
+        if (result.roll_count != 0)
+        {
+            printf("Min: %d\n", result.min_result);
+            printf("Max: %d\n", result.max_result);
+        }
+        printf("Mean: %f\n", diceSimulation_getMean(result));
+        printf("Standard deviation: %f\n", diceSimulation_getStandardDeviation(result));
+    }
+}
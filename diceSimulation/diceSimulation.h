@@ -0,0 +1,52 @@
+/**
+ * @file diceSimulation.h
+ * @author Kezia Marcou
+ * @brief Monte Carlo simulation of a compiled formula, rolled many times over several threads.
+ * Every thread rolls with its own non-overlapping RNG stream and keeps its own statistics, which are merged at the end.
+ * 
+ * Dependencies :
+ * - pthread
+ * 
+ */
+
+#ifndef INC_DICESIMULATION_H
+#define INC_DICESIMULATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "formulaParser.h"
+#include "simpleRNG.h"
+
+/// Formulas with more possible results than this are simulated without histogram
+#define DICE_SIMULATION_MAX_HISTOGRAM_LENGTH (1UL << 24)
+
+typedef enum
+{
+    DSIM_OK,
+    DSIM_ERR_ALLOC,
+    DSIM_ERR_THREAD
+} DiceSimulationError_t;
+
+/*---Structs---*/
+
+typedef struct
+{
+    uint64_t roll_count;
+    int64_t sum;
+    double sum_of_squares;
+    int32_t min_result;
+    int32_t max_result;
+    int64_t histogram_min;     // result counted in histogram[0]
+    uint32_t histogram_length; // 0 if the formula has too many possible results for a histogram
+    uint64_t *histogram;       // histogram[i] is the number of rolls that gave histogram_min + i
+} DiceSimulationResult_t;
+
+DiceSimulationError_t diceSimulation_run(const CompiledFormula_t *compiled_ptr, uint32_t flags, uint64_t roll_count, uint32_t thread_count, const simpleRNG_state_t *rng_ptr, DiceSimulationResult_t *result_ptr);
+void diceSimulation_deInit(DiceSimulationResult_t *result_ptr);
+
+double diceSimulation_getMean(DiceSimulationResult_t result);
+double diceSimulation_getStandardDeviation(DiceSimulationResult_t result);
+
+void diceSimulation_print(DiceSimulationResult_t result, bool table_only);
+
+#endif /* INC_DICESIMULATION_H */
@@ -0,0 +1,311 @@
+#include "formulaCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define ARENA_BLOCK_SIZE 4096 // enough for formulas of a few hundred elements without a second block
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+/**
+ * Hash a formula (64 bit FNV-1a)
+ * 
+ * @param formula 
+ * @param length_ptr set to the length of the formula
+ */
+uint64_t private_hashFormula(const char *formula, size_t *length_ptr)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    size_t length = 0;
+
+    while (formula[length] != '\0')
+    {
+        hash ^= (uint8_t) formula[length];
+        hash *= FNV_PRIME;
+        length++;
+    }
+
+    *length_ptr = length;
+    return hash;
+}
+
+/**
+ * Remove an entry from the LRU list
+ * 
+ * @param cache_ptr 
+ * @param entry_ptr 
+ */
+void private_unlinkEntry(FormulaCache_t *cache_ptr, FormulaCacheEntry_t *entry_ptr)
+{
+    if (entry_ptr->newer != NULL) {entry_ptr->newer->older = entry_ptr->older;}
+    else {cache_ptr->newest = entry_ptr->older;}
+
+    if (entry_ptr->older != NULL) {entry_ptr->older->newer = entry_ptr->newer;}
+    else {cache_ptr->oldest = entry_ptr->newer;}
+}
+
+/**
+ * Put an entry at the front (most recently used end) of the LRU list
+ * 
+ * @param cache_ptr 
+ * @param entry_ptr 
+ */
+void private_pushNewest(FormulaCache_t *cache_ptr, FormulaCacheEntry_t *entry_ptr)
+{
+    entry_ptr->newer = NULL;
+    entry_ptr->older = cache_ptr->newest;
+
+    if (cache_ptr->newest != NULL) {cache_ptr->newest->newer = entry_ptr;}
+    else {cache_ptr->oldest = entry_ptr;}
+
+    cache_ptr->newest = entry_ptr;
+}
+
+/**
+ * Free the least recently used entry, and return it so it can be reused
+ * 
+ * @param cache_ptr 
+ */
+FormulaCacheEntry_t *private_evictOldest(FormulaCache_t *cache_ptr)
+{
+    FormulaCacheEntry_t *entry_ptr = cache_ptr->oldest;
+    FormulaCacheEntry_t **link_ptr = &cache_ptr->buckets[entry_ptr->hash & cache_ptr->bucket_mask];
+
+    while (*link_ptr != entry_ptr)
+    {
+        link_ptr = &(*link_ptr)->bucket_next;
+    }
+    *link_ptr = entry_ptr->bucket_next;
+
+    private_unlinkEntry(cache_ptr, entry_ptr);
+    formulaParser_deInit(&entry_ptr->compiled);
+    free(entry_ptr->formula);
+    entry_ptr->formula = NULL;
+    cache_ptr->length--;
+
+    return entry_ptr;
+}
+
+/**
+ * Compile a formula in the arena of a cache without capacity, freeing the previous one
+ * 
+ * @param cache_ptr 
+ * @param formula 
+ * @param compiled_ptr 
+ */
+ParsedElementError_t private_compileUncached(FormulaCache_t *cache_ptr, const char *formula, const CompiledFormula_t **compiled_ptr)
+{
+    size_t length = strlen(formula);
+
+    arena_reset(&cache_ptr->arena);
+    cache_ptr->stats.miss_count++;
+
+    char *formula_copy = arena_alloc(&cache_ptr->arena, length + 1);
+    if (formula_copy == NULL)
+    {
+        return PELEM_ERR_ALLOC;
+    }
+    memcpy(formula_copy, formula, length + 1);
+
+    *compiled_ptr = &cache_ptr->uncached;
+    return formulaParser_compileInArena(formula_copy, &cache_ptr->uncached, &cache_ptr->arena);
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Initialize a formula cache
+ * 
+ * @param cache_ptr 
+ * @param capacity max number of formulas kept, 0 to keep none
+ */
+ParsedElementError_t formulaCache_init(FormulaCache_t *cache_ptr, uint32_t capacity)
+{
+    uint32_t bucket_count = 1;
+
+    // At least 2 buckets per entry, to keep chains short
+    while ((bucket_count < 2 * (uint64_t) capacity) && (bucket_count < (1U << 31)))
+    {
+        bucket_count *= 2;
+    }
+
+    cache_ptr->capacity = capacity;
+    cache_ptr->length = 0;
+    cache_ptr->bucket_mask = bucket_count - 1;
+    cache_ptr->entries = NULL;
+    cache_ptr->buckets = NULL;
+    cache_ptr->arena.first = NULL;
+    cache_ptr->newest = NULL;
+    cache_ptr->oldest = NULL;
+    cache_ptr->stats.hit_count = 0;
+    cache_ptr->stats.miss_count = 0;
+
+    bool is_allocated;
+    if (capacity == 0)
+    {
+        is_allocated = arena_init(&cache_ptr->arena, ARENA_BLOCK_SIZE);
+    }
+    else
+    {
+        cache_ptr->entries = calloc(capacity, sizeof *(cache_ptr->entries));
+        cache_ptr->buckets = calloc(bucket_count, sizeof *(cache_ptr->buckets));
+        is_allocated = (cache_ptr->entries != NULL) && (cache_ptr->buckets != NULL);
+    }
+
+    if (!is_allocated)
+    {
+        formulaCache_deInit(cache_ptr);
+        return PELEM_ERR_ALLOC;
+    }
+
+    return PELEM_OK;
+}
+
+/**
+ * Free a formula cache and every formula in it
+ * 
+ * @param cache_ptr 
+ */
+void formulaCache_deInit(FormulaCache_t *cache_ptr)
+{
+    if (cache_ptr->entries != NULL)
+    {
+        for (uint32_t i = 0; i < cache_ptr->capacity; i++)
+        {
+            if (cache_ptr->entries[i].formula != NULL)
+            {
+                formulaParser_deInit(&cache_ptr->entries[i].compiled);
+                free(cache_ptr->entries[i].formula);
+            }
+        }
+    }
+
+    if (cache_ptr->arena.first != NULL)
+    {
+        arena_deInit(&cache_ptr->arena);
+    }
+
+    free(cache_ptr->entries);
+    free(cache_ptr->buckets);
+    cache_ptr->entries = NULL;
+    cache_ptr->buckets = NULL;
+    cache_ptr->newest = NULL;
+    cache_ptr->oldest = NULL;
+    cache_ptr->length = 0;
+}
+
+/**
+ * Get the compiled form of a formula, compiling it (and caching it) only if it is not in the cache yet.
+ * Invalid formulas are not cached.
+ * 
+ * @param cache_ptr 
+ * @param formula 
+ * @param compiled_ptr set to the compiled formula, which belongs to the cache and stays valid until the next call
+ */
+ParsedElementError_t formulaCache_get(FormulaCache_t *cache_ptr, const char *formula, const CompiledFormula_t **compiled_ptr)
+{
+    size_t length;
+
+    if (cache_ptr->capacity == 0)
+    {
+        return private_compileUncached(cache_ptr, formula, compiled_ptr);
+    }
+
+    uint64_t hash = private_hashFormula(formula, &length);
+    FormulaCacheEntry_t **bucket_ptr = &cache_ptr->buckets[hash & cache_ptr->bucket_mask];
+
+    for (FormulaCacheEntry_t *entry_ptr = *bucket_ptr; entry_ptr != NULL; entry_ptr = entry_ptr->bucket_next)
+    {
+        if ((entry_ptr->hash == hash) && !strcmp(entry_ptr->formula, formula))
+        {
+            cache_ptr->stats.hit_count++;
+
+            if (entry_ptr != cache_ptr->newest)
+            {
+                private_unlinkEntry(cache_ptr, entry_ptr);
+                private_pushNewest(cache_ptr, entry_ptr);
+            }
+
+            *compiled_ptr = &entry_ptr->compiled;
+            return PELEM_OK;
+        }
+    }
+
+    cache_ptr->stats.miss_count++;
+
+    char *formula_copy = malloc(length + 1);
+    CompiledFormula_t compiled;
+
+    if (formula_copy == NULL)
+    {
+        return PELEM_ERR_ALLOC;
+    }
+    memcpy(formula_copy, formula, length + 1);
+
+    ParsedElementError_t status = formulaParser_compile(formula_copy, &compiled);
+    if (status != PELEM_OK)
+    {
+        free(formula_copy);
+        return status;
+    }
+
+    // Take a free entry, or the least recently used one
+    FormulaCacheEntry_t *entry_ptr;
+    if (cache_ptr->length == cache_ptr->capacity)
+    {
+        entry_ptr = private_evictOldest(cache_ptr);
+    }
+    else
+    {
+        entry_ptr = &cache_ptr->entries[cache_ptr->length];
+    }
+
+    entry_ptr->formula = formula_copy;
+    entry_ptr->compiled = compiled;
+    entry_ptr->hash = hash;
+    entry_ptr->bucket_next = *bucket_ptr;
+    *bucket_ptr = entry_ptr;
+    private_pushNewest(cache_ptr, entry_ptr);
+    cache_ptr->length++;
+
+    *compiled_ptr = &entry_ptr->compiled;
+    return PELEM_OK;
+}
+
+/**
+ * Get the number of lookups that found their formula in a cache, and of those that had to compile it
+ * 
+ * @param cache_ptr 
+ */
+FormulaCacheStats_t formulaCache_getStats(const FormulaCache_t *cache_ptr)
+{
+    return cache_ptr->stats;
+}
+
+/**
+ * Print the lookups of a cache to stderr
+ * 
+ * @param stats 
+ */
+void formulaCache_printStats(FormulaCacheStats_t stats)
+{
+    uint64_t lookup_count = stats.hit_count + stats.miss_count;
+
+    fprintf(stderr, "Cache stats :\n");
+    fprintf(stderr, "  hits            %10"PRIu64"\n", stats.hit_count);
+    fprintf(stderr, "  misses          %10"PRIu64"\n", stats.miss_count);
+    fprintf(stderr, "  hit rate        %10.1f %%\n", (lookup_count != 0) ? 100.0 * (double) stats.hit_count / (double) lookup_count : 0.0);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file formulaCache.h
+ * @author Kezia Marcou
+ * @brief LRU cache of compiled formulas, keyed by formula text.
+ * Formulas found in the cache skip tokenization and postfix conversion entirely.
+ * When the cache is full, the least recently used formula is freed to make room for the new one.
+ * A cache with a capacity of 0 keeps nothing : every formula is compiled in an arena reset on the next call,
+ * so that rolling never makes heap calls once the arena is big enough.
+ * 
+ */
+
+#ifndef INC_FORMULACACHE_H
+#define INC_FORMULACACHE_H
+
+#include <stdint.h>
+#include "parsedElements.h"
+#include "formulaParser.h"
+#include "arena.h"
+
+/*---Structs---*/
+
+/// Lookups of a cache since it was initialized
+typedef struct
+{
+    uint64_t hit_count;  // formulas found in the cache
+    uint64_t miss_count; // formulas that had to be compiled
+} FormulaCacheStats_t;
+
+typedef struct FormulaCacheEntry_s
+{
+    char *formula;                           // copy of the formula text, NULL if the entry is free
+    uint64_t hash;
+    CompiledFormula_t compiled;
+    struct FormulaCacheEntry_s *bucket_next; // next entry in the same hash bucket
+    struct FormulaCacheEntry_s *newer;       // LRU list neighbours
+    struct FormulaCacheEntry_s *older;
+} FormulaCacheEntry_t;
+
+typedef struct
+{
+    uint32_t capacity;             // max number of formulas kept, 0 to compile every formula in the arena
+    uint32_t length;               // number of formulas kept
+    uint32_t bucket_mask;          // bucket count - 1 (bucket count is a power of 2)
+    FormulaCacheEntry_t *entries;  // capacity entries, allocated once
+    FormulaCacheEntry_t **buckets;
+    FormulaCacheEntry_t *newest;   // most recently used entry
+    FormulaCacheEntry_t *oldest;   // least recently used entry, evicted first
+    Arena_t arena;                 // only used with a capacity of 0
+    CompiledFormula_t uncached;    // last formula compiled in the arena
+    FormulaCacheStats_t stats;
+} FormulaCache_t;
+
+ParsedElementError_t formulaCache_init(FormulaCache_t *cache_ptr, uint32_t capacity);
+void formulaCache_deInit(FormulaCache_t *cache_ptr);
+
+ParsedElementError_t formulaCache_get(FormulaCache_t *cache_ptr, const char *formula, const CompiledFormula_t **compiled_ptr);
+
+FormulaCacheStats_t formulaCache_getStats(const FormulaCache_t *cache_ptr);
+void formulaCache_printStats(FormulaCacheStats_t stats);
+
+#endif /* INC_FORMULACACHE_H */
@@ -0,0 +1,351 @@
+#include "formulaOptimizer.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+/// Node of the expression tree rebuilt from the postfix formula
+typedef struct
+{
+    ParsedElement_t element;
+    uint32_t left;  // operand nodes, for operators
+    uint32_t right;
+} OptimizerNode_t;
+
+/// Operand of a chain of additions and subtractions
+typedef struct
+{
+    uint32_t node;
+    bool is_negative;
+    bool is_removed; // merged into another term
+} OptimizerTerm_t;
+
+/// Pending step of the emission of the optimized formula
+typedef struct
+{
+    bool is_node;            // emit the subtree of node, otherwise append element
+    uint32_t node;
+    ParsedElement_t element;
+} OptimizerTask_t;
+
+typedef struct
+{
+    OptimizerNode_t *nodes;
+    uint32_t node_count;
+    OptimizerTerm_t *terms;         // operands of the chain being prepared
+    uint32_t term_count;
+    OptimizerTerm_t *collect_stack; // subtrees of the chain left to collect, as terms
+    OptimizerTask_t *tasks;         // used as a stack, so that formulas of any depth are emitted without recursion
+    uint32_t task_count;
+    ParsedElementArray_t *output_ptr;
+} Optimizer_t;
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+bool private_isNumber(const OptimizerNode_t *node_ptr, uint32_t value)
+{
+    return (node_ptr->element.type == TYPE_NUMBER) && (node_ptr->element.subtype == value);
+}
+
+/**
+ * Add an operator node, folding it if its operands are numbers and dropping it if it is an identity.
+ * Returns the index of the node that replaces the operation.
+ * 
+ * @param optimizer_ptr 
+ * @param op 
+ * @param left 
+ * @param right 
+ */
+uint32_t private_addOperation(Optimizer_t *optimizer_ptr, Operator_t op, uint32_t left, uint32_t right)
+{
+    OptimizerNode_t *nodes = optimizer_ptr->nodes;
+
+    // Constant folding, with the same 32 bit wrap-around as evaluation
+    if ((nodes[left].element.type == TYPE_NUMBER) && (nodes[right].element.type == TYPE_NUMBER))
+    {
+        uint32_t a = nodes[left].element.subtype;
+        uint32_t b = nodes[right].element.subtype;
+        uint32_t value = (op == OPERATOR_PLUS) ? (a + b) : (op == OPERATOR_MINUS) ? (a - b) : (a * b);
+
+        nodes[left].element.subtype = value;
+        return left;
+    }
+
+    // Identities
+    if ((op == OPERATOR_TIMES) && private_isNumber(&nodes[right], 1)) {return left;}
+    if ((op == OPERATOR_TIMES) && private_isNumber(&nodes[left], 1)) {return right;}
+    if ((op != OPERATOR_TIMES) && private_isNumber(&nodes[right], 0)) {return left;}
+    if ((op == OPERATOR_PLUS) && private_isNumber(&nodes[left], 0)) {return right;}
+
+    uint32_t index = optimizer_ptr->node_count;
+    nodes[index] = (OptimizerNode_t) {{TYPE_OPERATOR, op, 0}, left, right};
+    optimizer_ptr->node_count++;
+
+    return index;
+}
+
+/**
+ * Collect the operands of a chain of additions and subtractions, in the order they are written
+ * 
+ * @param optimizer_ptr 
+ * @param node root operator of the chain
+ */
+void private_collectTerms(Optimizer_t *optimizer_ptr, uint32_t node)
+{
+    OptimizerTerm_t *stack = optimizer_ptr->collect_stack;
+    uint32_t stack_size = 0;
+
+    stack[stack_size++] = (OptimizerTerm_t) {node, false, false};
+
+    while (stack_size > 0)
+    {
+        OptimizerTerm_t subtree = stack[--stack_size];
+        OptimizerNode_t *node_ptr = &optimizer_ptr->nodes[subtree.node];
+
+        if ((node_ptr->element.type == TYPE_OPERATOR) && (node_ptr->element.subtype != OPERATOR_TIMES))
+        {
+            // The left operand is pushed last so that it is collected first
+            bool is_right_negative = (node_ptr->element.subtype == OPERATOR_MINUS) ? !subtree.is_negative : subtree.is_negative;
+            stack[stack_size++] = (OptimizerTerm_t) {node_ptr->right, is_right_negative, false};
+            stack[stack_size++] = (OptimizerTerm_t) {node_ptr->left, subtree.is_negative, false};
+            continue;
+        }
+
+        optimizer_ptr->terms[optimizer_ptr->term_count] = subtree;
+        optimizer_ptr->term_count++;
+    }
+}
+
+/**
+ * Push a step of the emission, run after the steps pushed after it
+ * 
+ * @param optimizer_ptr 
+ * @param is_node emit the subtree of node, otherwise append element
+ * @param node 
+ * @param element 
+ */
+void private_pushTask(Optimizer_t *optimizer_ptr, bool is_node, uint32_t node, ParsedElement_t element)
+{
+    optimizer_ptr->tasks[optimizer_ptr->task_count] = (OptimizerTask_t) {is_node, node, element};
+    optimizer_ptr->task_count++;
+}
+
+/**
+ * Start emitting a chain of additions and subtractions, with its numbers summed into one,
+ * and its dice groups merged into the first group with the same side count and sign.
+ * A leading number is emitted right away, the terms and operators are pushed as tasks.
+ * 
+ * @param optimizer_ptr 
+ * @param node root operator of the chain
+ */
+ParsedElementError_t private_pushChain(Optimizer_t *optimizer_ptr, uint32_t node)
+{
+    OptimizerNode_t *nodes = optimizer_ptr->nodes;
+    uint32_t constant = 0;
+    bool has_constant = false;
+    ParsedElementError_t status = PELEM_OK;
+
+    optimizer_ptr->term_count = 0;
+    private_collectTerms(optimizer_ptr, node);
+    uint32_t end_term = optimizer_ptr->term_count;
+    OptimizerTerm_t *terms = optimizer_ptr->terms;
+
+    for (uint32_t i = 0; i < end_term; i++)
+    {
+        ParsedElement_t *element_ptr = &nodes[terms[i].node].element;
+
+        if (element_ptr->type == TYPE_NUMBER)
+        {
+            constant += terms[i].is_negative ? -element_ptr->subtype : element_ptr->subtype;
+            has_constant = true;
+            terms[i].is_removed = true;
+        }
+        else if ((element_ptr->type == TYPE_DICE_GROUP) && (element_ptr->subtype != 20))
+        {
+            for (uint32_t j = 0; j < i; j++)
+            {
+                ParsedElement_t *group_ptr = &nodes[terms[j].node].element;
+
+                if (!terms[j].is_removed && (terms[j].is_negative == terms[i].is_negative) && (group_ptr->type == TYPE_DICE_GROUP)
+                    && (group_ptr->subtype == element_ptr->subtype) && (group_ptr->count <= UINT32_MAX - element_ptr->count))
+                {
+                    group_ptr->count += element_ptr->count;
+                    terms[i].is_removed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // The first term written is never negative : the sum of numbers only goes first if dice terms start negative
+    uint32_t first_kept = 0;
+    while ((first_kept < end_term) && terms[first_kept].is_removed)
+    {
+        first_kept++;
+    }
+
+    bool is_constant_first = (first_kept == end_term) || terms[first_kept].is_negative;
+    if (is_constant_first)
+    {
+        status = parsedElements_arrayAppend(optimizer_ptr->output_ptr, (ParsedElement_t) {TYPE_NUMBER, constant, 0});
+    }
+
+    // Tasks run in reverse order : the trailing number first, then every term from the last one
+    if (!is_constant_first && has_constant && (constant != 0))
+    {
+        private_pushTask(optimizer_ptr, false, 0, (ParsedElement_t) {TYPE_OPERATOR, OPERATOR_PLUS, 0});
+        private_pushTask(optimizer_ptr, false, 0, (ParsedElement_t) {TYPE_NUMBER, constant, 0});
+    }
+
+    for (uint32_t i = end_term; i > first_kept; i--)
+    {
+        const OptimizerTerm_t *term_ptr = &terms[i - 1];
+
+        if (term_ptr->is_removed)
+        {
+            continue;
+        }
+
+        if ((i - 1 != first_kept) || is_constant_first)
+        {
+            Operator_t op = term_ptr->is_negative ? OPERATOR_MINUS : OPERATOR_PLUS;
+            private_pushTask(optimizer_ptr, false, 0, (ParsedElement_t) {TYPE_OPERATOR, op, 0});
+        }
+        private_pushTask(optimizer_ptr, true, term_ptr->node, (ParsedElement_t) {0});
+    }
+
+    return status;
+}
+
+/**
+ * Emit a node and its operands in postfix order, with an explicit stack of tasks.
+ * Returns PELEM_ERR_ALLOC if the output could not grow.
+ * 
+ * @param optimizer_ptr 
+ * @param node 
+ */
+ParsedElementError_t private_emitNode(Optimizer_t *optimizer_ptr, uint32_t node)
+{
+    ParsedElementError_t status = PELEM_OK;
+
+    optimizer_ptr->task_count = 0;
+    private_pushTask(optimizer_ptr, true, node, (ParsedElement_t) {0});
+
+    while ((optimizer_ptr->task_count > 0) && (status == PELEM_OK))
+    {
+        optimizer_ptr->task_count--;
+        OptimizerTask_t task = optimizer_ptr->tasks[optimizer_ptr->task_count];
+
+        if (!task.is_node)
+        {
+            status = parsedElements_arrayAppend(optimizer_ptr->output_ptr, task.element);
+            continue;
+        }
+
+        OptimizerNode_t node_copy = optimizer_ptr->nodes[task.node];
+
+        if (node_copy.element.type != TYPE_OPERATOR)
+        {
+            status = parsedElements_arrayAppend(optimizer_ptr->output_ptr, node_copy.element);
+        }
+        else if (node_copy.element.subtype != OPERATOR_TIMES)
+        {
+            status = private_pushChain(optimizer_ptr, task.node);
+        }
+        else
+        {
+            private_pushTask(optimizer_ptr, false, 0, node_copy.element);
+            private_pushTask(optimizer_ptr, true, node_copy.right, (ParsedElement_t) {0});
+            private_pushTask(optimizer_ptr, true, node_copy.left, (ParsedElement_t) {0});
+        }
+    }
+
+    return status;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Optimize a valid postfix formula. The optimized formula gives the same results (with the same distribution),
+ * but can throw its dice in a different order, except for d20s.
+ * Returns PELEM_ERR_ALLOC if the scratch memory or the optimized formula could not be allocated.
+ * 
+ * @param postfix valid postfix formula (checked by the parser)
+ * @param optimized_ptr initialized array the optimized postfix formula is appended to
+ * @param arena_ptr arena the scratch memory is taken from (kept until it is reset), NULL for the heap
+ */
+ParsedElementError_t formulaOptimizer_optimize(ParsedElementArray_t postfix, ParsedElementArray_t *optimized_ptr, Arena_t *arena_ptr)
+{
+    size_t length = postfix.current_length;
+
+    // Every node is emitted once and appends at most one operator, every chain adds at most a number and an operator
+    size_t task_capacity = 3 * length + 1;
+    size_t scratch_size = length * (sizeof(OptimizerNode_t) + 2 * sizeof(OptimizerTerm_t) + sizeof(uint32_t))
+        + task_capacity * sizeof(OptimizerTask_t);
+    void *scratch;
+
+    if (arena_ptr != NULL)
+    {
+        scratch = arena_alloc(arena_ptr, scratch_size);
+    }
+    else
+    {
+        scratch = malloc(scratch_size);
+    }
+
+    if (scratch == NULL)
+    {
+        return PELEM_ERR_ALLOC;
+    }
+
+    Optimizer_t optimizer = {
+        .nodes = scratch,
+        .node_count = 0,
+        .terms = (OptimizerTerm_t *) ((OptimizerNode_t *) scratch + length),
+        .term_count = 0,
+        .task_count = 0,
+        .output_ptr = optimized_ptr
+    };
+    optimizer.collect_stack = optimizer.terms + length;
+    optimizer.tasks = (OptimizerTask_t *) (optimizer.collect_stack + length);
+    uint32_t *node_stack = (uint32_t *) (optimizer.tasks + task_capacity);
+    uint32_t node_stack_size = 0;
+
+    // Rebuild the expression tree, folding it on the way
+    for (uint32_t i = 0; i < length; i++)
+    {
+        ParsedElement_t element = postfix.array[i];
+
+        if (element.type == TYPE_OPERATOR)
+        {
+            uint32_t right = node_stack[node_stack_size - 1];
+            uint32_t left = node_stack[node_stack_size - 2];
+            node_stack_size--;
+            node_stack[node_stack_size - 1] = private_addOperation(&optimizer, element.subtype, left, right);
+        }
+        else
+        {
+            optimizer.nodes[optimizer.node_count] = (OptimizerNode_t) {element, 0, 0};
+            node_stack[node_stack_size] = optimizer.node_count;
+            node_stack_size++;
+            optimizer.node_count++;
+        }
+    }
+
+    ParsedElementError_t status = private_emitNode(&optimizer, node_stack[0]);
+
+    // The optimized array can have grown in the arena after the scratch memory : it stays until the arena is reset
+    if (arena_ptr == NULL)
+    {
+        free(scratch);
+    }
+
+    return status;
+}
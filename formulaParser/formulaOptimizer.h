@@ -0,0 +1,19 @@
+/**
+ * @file formulaOptimizer.h
+ * @author Kezia Marcou
+ * @brief Optimization pass over postfix formulas, so that compiled formulas do less work per roll.
+ * Constant subexpressions are folded, identity operations (*1, +0, -0) are dropped,
+ * and dice groups with the same side count added with the same sign are merged (1d6+1d6+1d6+2+3 -> 3d6+5).
+ * d20 groups are never merged, so advantage and disadvantage apply to the same dice as in the written formula.
+ * 
+ */
+
+#ifndef INC_FORMULAOPTIMIZER_H
+#define INC_FORMULAOPTIMIZER_H
+
+#include "parsedElements.h"
+#include "arena.h"
+
+ParsedElementError_t formulaOptimizer_optimize(ParsedElementArray_t postfix, ParsedElementArray_t *optimized_ptr, Arena_t *arena_ptr);
+
+#endif /* INC_FORMULAOPTIMIZER_H */
@@ -1,16 +1,42 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
 #include "formulaParser.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "parsedElements.h"
 #include "simpleRNG.h"
+#include "arena.h"
+#include "formulaOptimizer.h"
+#include "rollTrace.h"
+#include "allocCounter.h"
 
 /************************************************************************************************************
  * Macros, enums, structs, variables
  */
 
 #define ELEMENT_BUFFER_SIZE 16 // you overflow your memory with dice elements before this buffer size is a problem
+#define OPERATOR_STACK_SIZE 128 // max number of operators waiting during postfix conversion (mostly nested parentheses)
+#define MAX_NESTING_DEPTH OPERATOR_STACK_SIZE // max depth of parentheses read by the single pass evaluator
+#define LOCAL_NUMBER_STACK_SIZE 64 // evaluation needing a bigger number stack allocates it
+#define DICE_FILL_MIN_COUNT 16 // dice groups with at least this many dice are thrown in bulk
+#define DICE_FILL_BUFFER_SIZE 256 // number of dice thrown per bulk call
+#define MULTINOMIAL_DICE_PER_SIDE 64 // dice groups with more dice per side than this draw how many dice show each face instead
+#define STEPS_TRACE_MAX_RECORDS (1U << 20) // rolls printing steps with more records than this are streamed instead of traced at once
+#define STEPS_STREAM_RECORDS (1U << 16) // number of records printed per chunk when streaming steps
+
+/// State of a formula being parsed and calculated in a single pass
+typedef struct
+{
+    const char *position; // next char to read
+    simpleRNG_state_t *rng_ptr;
+    bool is_advantage;    // the first d20 has not been thrown yet, and must be thrown with advantage
+    bool is_disadvantage;
+    uint32_t depth;       // number of parentheses open
+} FormulaReader_t;
 
 /************************************************************************************************************
  * Private functions
@@ -20,8 +46,9 @@
  * Get the first number that can be read in the string. Any non-digit char found ends the function
  * 
  * @param str
+ * @param end_ptr set to the first char after the number (the start of the string if there is no digit)
  */
-uint32_t private_getFirstNumber(char *string)
+uint32_t private_getFirstNumber(char *string, char **end_ptr)
 {
     uint32_t res = 0;
     uint32_t index = 0;
@@ -33,68 +60,70 @@ uint32_t private_getFirstNumber(char *string)
         index++;
     }
 
+    *end_ptr = &string[index];
     return res;
 }
 
 /**
- * Parse an element in string form into an element array
+ * Parse an element in string form
  * 
- * @param element_array_ptr 
  * @param buffer 
+ * @param element_ptr set to the parsed element
  */
-ParsedElementError_t private_parseElementInBuffer(ParsedElementArray_t *element_array_ptr, char *buffer)
+ParsedElementError_t private_parseElement(char *buffer, ParsedElement_t *element_ptr)
 {
-    // This handles dice and numbers.
-    //TODO: make this return an error if the string is invalid (contains something other than 0-9 and d)
-    
-    // Check if string is empty
-    if (strlen(buffer) == 0)
+    // This handles dice (NdS) and numbers. Anything else is invalid
+    char *end_ptr;
+    uint32_t number = private_getFirstNumber(buffer, &end_ptr);
+
+    // Check if string is empty or does not start with a number
+    if (end_ptr == buffer)
     {
         return PELEM_ERR_INVALID_INPUT;
     }
-    
-
-    char * dice_ptr = strchr(buffer, 'd');
 
-    if (dice_ptr != NULL)
+    if (*end_ptr == 'd')
     {
-        uint32_t dice_count = private_getFirstNumber(buffer);
-        uint32_t dice_sides = private_getFirstNumber(dice_ptr + 1);
+        char *sides_ptr = end_ptr + 1;
+        uint32_t dice_count = number;
+        uint32_t dice_sides = private_getFirstNumber(sides_ptr, &end_ptr);
 
-        if (dice_count == 0 || dice_sides == 0)
+        if (dice_count == 0 || dice_sides == 0 || *end_ptr != '\0')
         {
             return PELEM_ERR_INVALID_INPUT;
         }
 
-        parsedElements_arrayAppend(element_array_ptr, (ParsedElement_t) {TYPE_OPERATOR, OPERATOR_OPEN_P});
-        
-        for (uint32_t i = 0; i < dice_count; i++)
-        {
-            parsedElements_arrayAppend(element_array_ptr, (ParsedElement_t) {TYPE_DICE, dice_sides});
-            parsedElements_arrayAppend(element_array_ptr, (ParsedElement_t) {TYPE_OPERATOR, OPERATOR_PLUS});
-        }
-
-        // Replace last "+" with ")"
-        ParsedElementError_t status = parsedElements_arraySetElement(element_array_ptr, element_array_ptr->current_length - 1, (ParsedElement_t) {TYPE_OPERATOR, OPERATOR_CLOSE_P});
-        if (status)
-        {
-            return status;
-        }
-        
+        *element_ptr = (ParsedElement_t) {TYPE_DICE_GROUP, dice_sides, dice_count};
+    }
+    else if (*end_ptr == '\0')
+    {
+        *element_ptr = (ParsedElement_t) {TYPE_NUMBER, number, 0};
     }
-    else 
+    else
     {
-        uint32_t number = private_getFirstNumber(buffer);
+        return PELEM_ERR_INVALID_INPUT;
+    }
+
+    return PELEM_OK;
+}
 
-        ParsedElement_t number_element = {
-            .type = TYPE_NUMBER,
-            .subtype = number
-        };
+/**
+ * Parse an element in string form into an element array
+ * 
+ * @param element_array_ptr 
+ * @param buffer 
+ */
+ParsedElementError_t private_parseElementInBuffer(ParsedElementArray_t *element_array_ptr, char *buffer)
+{
+    ParsedElement_t element;
+    ParsedElementError_t status = private_parseElement(buffer, &element);
 
-        parsedElements_arrayAppend(element_array_ptr, number_element);
+    if (status == PELEM_OK)
+    {
+        status = parsedElements_arrayAppend(element_array_ptr, element);
     }
 
-    return PELEM_OK;
+    return status;
 }
 
 uint32_t private_getOperatorPrecedence(Operator_t op)
@@ -123,260 +152,1259 @@ uint32_t private_getOperatorPrecedence(Operator_t op)
 }
 
 /**
- * Calculates the result of the expression of the given array that contains no dice.
- * Does not modify the given array
+ * Transform a string formula into an array of ParsedElements (in the order they are written)
  * 
- * @param element_array 
+ * @param formula 
+ * @param element_array_ptr initialized array the elements are appended to
  */
-int32_t private_calculateExpression(ParsedElementArray_t element_array)
+ParsedElementError_t private_tokenizeFormula(char *formula, ParsedElementArray_t *element_array_ptr)
 {
-    int32_t retval = 0;
-    
-    // For the shunting yard algorithm
-    ParsedElement_t *elements_postfix = malloc(element_array.current_length * (sizeof *elements_postfix));
-    Operator_t operator_stack[128] = {0}; //TODO: dynamic allocation maybe, or document limitations
-    uint32_t current_op_stack_size = 0;
-    uint32_t current_postfix_size = 0;
+    char current_element[ELEMENT_BUFFER_SIZE] = {0}; 
+    uint32_t element_length = 0; // current index in the element
+    ParsedElementError_t status = PELEM_OK;
 
-    // Init elements_postfix array
-    for (uint32_t i = 0; i < element_array.current_length; i++)
+    for (uint32_t i = 0; formula[i] != '\0'; i++)    
     {
-        elements_postfix[i].type = TYPE_NONE;
-        elements_postfix[i].subtype = 0;
+        if (parsedElements_charToOperator(formula[i]) == NOT_AN_OPERATOR)
+        {
+            current_element[element_length] = formula[i];
+            element_length++;
+
+            if (element_length >= ELEMENT_BUFFER_SIZE - 1)
+            {
+                return PELEM_ERR_INVALID_INPUT;
+            }
+        }
+        else
+        {
+            if (element_length != 0)
+            {
+                status = private_parseElementInBuffer(element_array_ptr, current_element);
+                if (status)
+                {
+                    return status;
+                }
+
+                memset(current_element, 0, ELEMENT_BUFFER_SIZE);
+                element_length = 0;
+            }
+
+            status = parsedElements_arrayAppend(element_array_ptr, (ParsedElement_t) {TYPE_OPERATOR, parsedElements_charToOperator(formula[i]), 0});
+            if (status)
+            {
+                return status;
+            }
+        }
     }
-    
-    // Transform to postfix (Shunting Yard algorithm)
-    for (uint32_t i = 0; i < element_array.current_length; i++)
+
+    if (element_length != 0)
+    {
+        status = private_parseElementInBuffer(element_array_ptr, current_element);
+    }
+
+    return status;
+}
+
+/**
+ * Convert an infix element array to postfix notation (Shunting Yard algorithm).
+ * Dice groups are kept as they are, so that they can be thrown every time the postfix formula is evaluated.
+ * 
+ * @param infix 
+ * @param postfix_ptr initialized array the postfix elements are appended to
+ */
+ParsedElementError_t private_convertToPostfix(ParsedElementArray_t infix, ParsedElementArray_t *postfix_ptr)
+{
+    Operator_t operator_stack[OPERATOR_STACK_SIZE] = {0};
+    uint32_t current_op_stack_size = 0;
+    bool is_expecting_value = true; // values and '(' must follow operators and '(', the other operators must follow values and ')'
+    ParsedElementError_t status = PELEM_OK;
+
+    for (uint32_t i = 0; i < infix.current_length; i++)
     {
-        ElementType_t current_type = element_array.array[i].type;
-        uint32_t current_subtype = element_array.array[i].subtype;
+        ParsedElement_t current_element = infix.array[i];
+        bool is_value = (current_element.type != TYPE_OPERATOR) || (current_element.subtype == OPERATOR_OPEN_P);
+
+        if (is_value != is_expecting_value)
+        {
+            return PELEM_ERR_INVALID_INPUT;
+        }
+        is_expecting_value = (current_element.type == TYPE_OPERATOR) && (current_element.subtype != OPERATOR_CLOSE_P);
 
-        switch (current_type)
+        switch (current_element.type)
         {
         case TYPE_NUMBER:
-            elements_postfix[current_postfix_size].type = current_type;
-            elements_postfix[current_postfix_size].subtype = current_subtype;
-            current_postfix_size++;
+        case TYPE_DICE_GROUP:
+            status = parsedElements_arrayAppend(postfix_ptr, current_element);
             break;
 
         case TYPE_OPERATOR:
-            if (current_subtype == OPERATOR_CLOSE_P)
+            if (current_element.subtype == OPERATOR_CLOSE_P)
             {
-                while ((current_op_stack_size != 0) && (operator_stack[current_op_stack_size - 1] != OPERATOR_OPEN_P))
+                while ((status == PELEM_OK) && (current_op_stack_size != 0) && (operator_stack[current_op_stack_size - 1] != OPERATOR_OPEN_P))
                 {
-                    elements_postfix[current_postfix_size].type = TYPE_OPERATOR;
-                    elements_postfix[current_postfix_size].subtype = operator_stack[current_op_stack_size - 1];
-                    current_postfix_size++;
+                    status = parsedElements_arrayAppend(postfix_ptr, (ParsedElement_t) {TYPE_OPERATOR, operator_stack[current_op_stack_size - 1], 0});
                     current_op_stack_size--;
                 }
+
+                if (status != PELEM_OK)
+                {
+                    return status;
+                }
+
+                // No matching '('
+                if (current_op_stack_size == 0)
+                {
+                    return PELEM_ERR_INVALID_INPUT;
+                }
+
                 // pop the '(' into nothing
                 current_op_stack_size--;
             }
             else 
             {
-                uint32_t precedence = private_getOperatorPrecedence(current_subtype);
-            
-                while ((current_op_stack_size != 0) && (precedence <= private_getOperatorPrecedence(operator_stack[current_op_stack_size])))
+                if (current_element.subtype != OPERATOR_OPEN_P)
                 {
-                    elements_postfix[current_postfix_size].type = TYPE_OPERATOR;
-                    elements_postfix[current_postfix_size].subtype = operator_stack[current_op_stack_size - 1];
-                    current_postfix_size++;
-                    current_op_stack_size--;
+                    uint32_t precedence = private_getOperatorPrecedence(current_element.subtype);
+
+                    while ((status == PELEM_OK) && (current_op_stack_size != 0) 
+                        && (operator_stack[current_op_stack_size - 1] != OPERATOR_OPEN_P)
+                        && (precedence <= private_getOperatorPrecedence(operator_stack[current_op_stack_size - 1])))
+                    {
+                        status = parsedElements_arrayAppend(postfix_ptr, (ParsedElement_t) {TYPE_OPERATOR, operator_stack[current_op_stack_size - 1], 0});
+                        current_op_stack_size--;
+                    }
+                }
+
+                if (current_op_stack_size >= OPERATOR_STACK_SIZE)
+                {
+                    return PELEM_ERR_OOB;
                 }
-                operator_stack[current_op_stack_size] = current_subtype;
+
+                operator_stack[current_op_stack_size] = current_element.subtype;
                 current_op_stack_size++;
             }
             break;
         
         default:
-            retval = -9999;
-            goto end;
+            return PELEM_ERR_INVALID_INPUT;
             break;
         }
-        
+
+        if (status != PELEM_OK)
+        {
+            return status;
+        }
     }
 
     // Process the remaining operators
-    while (current_op_stack_size != 0)
+    while ((status == PELEM_OK) && (current_op_stack_size != 0))
     {
-        elements_postfix[current_postfix_size].type = TYPE_OPERATOR;
-        elements_postfix[current_postfix_size].subtype = operator_stack[current_op_stack_size - 1];
-        current_postfix_size++;
+        // Unclosed '('
+        if (operator_stack[current_op_stack_size - 1] == OPERATOR_OPEN_P)
+        {
+            return PELEM_ERR_INVALID_INPUT;
+        }
+
+        status = parsedElements_arrayAppend(postfix_ptr, (ParsedElement_t) {TYPE_OPERATOR, operator_stack[current_op_stack_size - 1], 0});
         current_op_stack_size--;
     }
 
-    // Evaluate postfix expression
-    int32_t *number_stack = malloc(current_postfix_size * (sizeof *number_stack));
-    uint32_t number_stack_size = 0;
+    return status;
+}
+
+/**
+ * Check that a postfix formula can be evaluated, and compute the size of the number stack it needs
+ * 
+ * @param compiled_ptr compiled formula whose postfix array is filled. Its stack_depth and dice_count are set.
+ */
+ParsedElementError_t private_analyzePostfix(CompiledFormula_t *compiled_ptr)
+{
+    uint32_t stack_size = 0;
+
+    compiled_ptr->stack_depth = 0;
+    compiled_ptr->dice_count = 0;
 
-    for (uint32_t i = 0; i < current_postfix_size; i++)
+    for (uint32_t i = 0; i < compiled_ptr->postfix.current_length; i++)
     {
-        if (elements_postfix[i].type == TYPE_NUMBER)
+        if (compiled_ptr->postfix.array[i].type == TYPE_OPERATOR)
         {
-            number_stack[number_stack_size] = elements_postfix[i].subtype;
-            number_stack_size++;
+            // Every operator takes 2 numbers and gives back 1
+            if (stack_size < 2)
+            {
+                return PELEM_ERR_INVALID_INPUT;
+            }
+            stack_size--;
         }
-        else 
+        else
         {
-            if (number_stack_size < 2)
+            if (compiled_ptr->postfix.array[i].type == TYPE_DICE_GROUP)
             {
-                retval = -8888;
-                goto end;
+                compiled_ptr->dice_count += compiled_ptr->postfix.array[i].count;
             }
 
-            int32_t num1 = number_stack[number_stack_size - 1];
-            number_stack_size--;
-            int32_t num2 = number_stack[number_stack_size - 1];
-            number_stack_size--;
-
-            // Operator handling
-            switch (elements_postfix[i].subtype)
+            stack_size++;
+            if (stack_size > compiled_ptr->stack_depth)
             {
-            case OPERATOR_PLUS:
-                number_stack[number_stack_size] = num2 + num1;
-                number_stack_size++;
-                break;
-
-            case OPERATOR_MINUS:
-                number_stack[number_stack_size] = num2 - num1;
-                number_stack_size++;
-                break;
-
-            case OPERATOR_TIMES:
-                number_stack[number_stack_size] = num2 * num1;
-                number_stack_size++;
-                break;                
-            
-            default:
-                break;
+                compiled_ptr->stack_depth = stack_size;
             }
         }
-        
     }
-    
-    if (number_stack_size == 0)
+
+    // Exactly one number must be left : the result
+    if (stack_size != 1)
     {
-        retval = -7777;
-        goto end;
+        return PELEM_ERR_INVALID_INPUT;
     }
-    
-    retval = number_stack[0];
-end:
-    free(elements_postfix);
-    free(number_stack);
-    return retval;
+
+    return PELEM_OK;
 }
 
+/**
+ * Throw a single die, handling advantage/disadvantage on d20s.
+ * 
+ * @param rng_ptr
+ * @param side_count 
+ * @param is_advantage_ptr pending advantage, consumed by the first d20
+ * @param is_disadvantage_ptr pending disadvantage, consumed by the first d20 without advantage
+ * @param trace_ptr if not NULL, advantage/disadvantage pairs are recorded here
+ */
+uint32_t private_throwDice(simpleRNG_state_t *rng_ptr, uint32_t side_count, bool *is_advantage_ptr, bool *is_disadvantage_ptr, RollTrace_t *trace_ptr)
+{
+    uint32_t dice_result = 0;
 
+    if (*is_advantage_ptr && (side_count == 20))
+    {
+        // d20 with advantage
+        uint32_t dice1 = simpleRNG_randomUint32InRange_r(rng_ptr, 1, side_count);
+        uint32_t dice2 = simpleRNG_randomUint32InRange_r(rng_ptr, 1, side_count);
 
-/************************************************************************************************************
- * Public functions
- */
+        dice_result = (dice1 > dice2) ? dice1 : dice2;
+
+        if (trace_ptr != NULL) {rollTrace_record(trace_ptr, TRACE_EVENT_ADVANTAGE, dice1, dice2);}
+        *is_advantage_ptr = false;
+    } 
+    else if (*is_disadvantage_ptr && (side_count == 20))
+    {
+        // d20 with disadvantage
+        uint32_t dice1 = simpleRNG_randomUint32InRange_r(rng_ptr, 1, side_count);
+        uint32_t dice2 = simpleRNG_randomUint32InRange_r(rng_ptr, 1, side_count);
+
+        dice_result = (dice1 < dice2) ? dice1 : dice2;
+
+        if (trace_ptr != NULL) {rollTrace_record(trace_ptr, TRACE_EVENT_DISADVANTAGE, dice1, dice2);}
+        *is_disadvantage_ptr = false;
+    }
+    else
+    {
+        dice_result = simpleRNG_randomUint32InRange_r(rng_ptr, 1, side_count);
+    }
+
+    return dice_result;
+}
 
-int32_t formulaParser_calculateFormula(char *formula, bool is_advantage, bool is_disadvantage, bool print_steps)
+/**
+ * Get the sum of dice_count dice without throwing them one by one : draw how many dice show each face
+ * (multinomial distribution), as a binomial per face. Exact in distribution, in O(side_count) whatever the dice count.
+ * 
+ * @param rng_ptr
+ * @param side_count
+ * @param dice_count
+ */
+uint32_t private_sumDiceByFace(simpleRNG_state_t *rng_ptr, uint32_t side_count, uint32_t dice_count)
 {
-    // ---Transform string into array of ParsedElements
+    uint64_t sum = 0;
+    uint64_t remaining_count = dice_count;
 
-    ParsedElementArray_t parsed_formula;
-    char current_element[ELEMENT_BUFFER_SIZE] = {0}; 
-    uint32_t element_length = 0; // current index in the element
+    for (uint32_t face = 1; (face < side_count) && (remaining_count != 0); face++)
+    {
+        // A die that did not show a lower face shows each of the side_count - face + 1 faces left with the same probability
+        uint64_t face_count = simpleRNG_randomBinomial_r(rng_ptr, remaining_count, 1.0 / (side_count - face + 1));
+        sum += face * face_count;
+        remaining_count -= face_count;
+    }
+
+    // Every die left shows the last face
+    sum += remaining_count * side_count;
+
+    return (uint32_t) sum;
+}
 
-    parsedElements_arrayInit(&parsed_formula);
+/**
+ * Throw every die of a dice group and get their sum.
+ * Big groups are thrown in bulk, or summed by face count when there are many dice per side.
+ * 
+ * @param rng_ptr
+ * @param group TYPE_DICE_GROUP element
+ * @param is_advantage_ptr pending advantage, consumed by the first d20
+ * @param is_disadvantage_ptr pending disadvantage, consumed by the first d20 without advantage
+ * @param trace_ptr if not NULL, every die is thrown one by one and recorded here
+ */
+uint32_t private_throwDiceGroup(simpleRNG_state_t *rng_ptr, ParsedElement_t group, bool *is_advantage_ptr, bool *is_disadvantage_ptr, RollTrace_t *trace_ptr)
+{
+    uint32_t side_count = group.subtype;
+    uint32_t sum = 0;
+    uint32_t i = 0;
 
-    for (uint32_t i = 0; i < strlen(formula); i++)    
+    if (trace_ptr != NULL)
     {
-        if (parsedElements_charToOperator(formula[i]) == NOT_AN_OPERATOR)
+        for (i = 0; i < group.count; i++)
         {
-            current_element[element_length] = formula[i];
-            element_length++;
-
-            if (element_length >= ELEMENT_BUFFER_SIZE - 1)
-            {
-                return -6666;
-            }
+            uint32_t dice_result = private_throwDice(rng_ptr, side_count, is_advantage_ptr, is_disadvantage_ptr, trace_ptr);
+            rollTrace_record(trace_ptr, TRACE_EVENT_DIE, side_count, dice_result);
+            sum += dice_result;
         }
-        else
+
+        return sum;
+    }
+
+    // Advantage is consumed by the first d20 and disadvantage by the next one, so up to the first two dice can be pending
+    while ((i < group.count) && (side_count == 20) && (*is_advantage_ptr || *is_disadvantage_ptr))
+    {
+        sum += private_throwDice(rng_ptr, side_count, is_advantage_ptr, is_disadvantage_ptr, NULL);
+        i++;
+    }
+
+    if ((group.count - i) / MULTINOMIAL_DICE_PER_SIDE >= side_count)
+    {
+        sum += private_sumDiceByFace(rng_ptr, side_count, group.count - i);
+        i = group.count;
+    }
+    else if (group.count - i >= DICE_FILL_MIN_COUNT)
+    {
+        uint32_t dice_buffer[DICE_FILL_BUFFER_SIZE];
+
+        while (i < group.count)
         {
-            if (element_length != 0)
+            uint32_t fill_count = (group.count - i < DICE_FILL_BUFFER_SIZE) ? (group.count - i) : DICE_FILL_BUFFER_SIZE;
+
+            simpleRNG_fillUint32InRange_r(rng_ptr, dice_buffer, fill_count, 1, side_count);
+            for (uint32_t j = 0; j < fill_count; j++)
             {
-                private_parseElementInBuffer(&parsed_formula, current_element);
-                memset(current_element, 0, ELEMENT_BUFFER_SIZE);
-                element_length = 0;
+                sum += dice_buffer[j];
             }
 
-            parsedElements_arrayAppend(&parsed_formula, (ParsedElement_t) {TYPE_OPERATOR, parsedElements_charToOperator(formula[i])});
+            i += fill_count;
         }
     }
 
-    if (element_length != 0)
+    for (; i < group.count; i++)
     {
-        private_parseElementInBuffer(&parsed_formula, current_element);
+        sum += simpleRNG_randomUint32InRange_r(rng_ptr, 1, side_count);
     }
 
-    // Print formula
-    if (print_steps) 
+    return sum;
+}
+
+/**
+ * Allocate scratch memory from an arena, or from the heap if there is none
+ * 
+ * @param arena_ptr 
+ * @param size 
+ */
+void *private_allocate(Arena_t *arena_ptr, size_t size)
+{
+    if (arena_ptr != NULL)
     {
-        parsedElement_printArray(parsed_formula);
-        printf("\n");
+        return arena_alloc(arena_ptr, size);
     }
 
-    // ---Roll dice to transform into numbers
-    if (print_steps) {printf("---Throwing dice---\n");}
+    return malloc(size);
+}
+
+/**
+ * Optimize the postfix formula and compile it to bytecode (see FormulaOpcode_t).
+ * The stack depth is raised if the optimized formula needs a deeper stack.
+ * 
+ * @param compiled_ptr analyzed formula, its bytecode is allocated from its arena (or the heap)
+ */
+ParsedElementError_t private_compileBytecode(CompiledFormula_t *compiled_ptr)
+{
+    ParsedElementArray_t postfix;
+    uint32_t length = 1; // OPCODE_END
+    uint32_t stack_size = 0;
 
-    for (uint32_t i = 0; i < parsed_formula.current_length; i++)
+    ParsedElementError_t status = parsedElements_arrayInitInArena(&postfix, compiled_ptr->arena_ptr);
+    if (status == PELEM_OK)
     {
-        if (parsed_formula.array[i].type == TYPE_DICE)
-        {
-            uint32_t side_count = parsed_formula.array[i].subtype;
-            uint32_t dice_result = 0;
+        status = formulaOptimizer_optimize(compiled_ptr->postfix, &postfix, compiled_ptr->arena_ptr);
+    }
 
-            if (is_advantage && (side_count == 20))
-            {
-                // d20 with advantage
-                uint32_t dice1 = simpleRNG_randomUint32InRange(1, side_count);
-                uint32_t dice2 = simpleRNG_randomUint32InRange(1, side_count);
+    if (status != PELEM_OK)
+    {
+        parsedElements_arrayDeInit(&postfix);
+        return status;
+    }
 
-                dice_result = (dice1 > dice2) ? dice1 : dice2;
+    for (uint32_t i = 0; i < postfix.current_length; i++)
+    {
+        ParsedElement_t element = postfix.array[i];
 
-                if (print_steps) {printf("Throwing d20 with advantage: {%d, %d} -> >%d<\n", dice1, dice2, dice_result);}
-                is_advantage = false;
-            } 
-            else if (is_disadvantage && (side_count == 20))
-            {
-                // d20 with disadvantage
-                uint32_t dice1 = simpleRNG_randomUint32InRange(1, side_count);
-                uint32_t dice2 = simpleRNG_randomUint32InRange(1, side_count);
+        if (element.type == TYPE_NUMBER) {length += 2;}
+        else if (element.type == TYPE_DICE_GROUP) {length += 3;}
+        else {length += 1;}
+    }
+
+    uint32_t *bytecode = private_allocate(compiled_ptr->arena_ptr, length * (sizeof *bytecode));
+    if (bytecode == NULL)
+    {
+        parsedElements_arrayDeInit(&postfix);
+        return PELEM_ERR_ALLOC;
+    }
+
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < postfix.current_length; i++)
+    {
+        ParsedElement_t element = postfix.array[i];
+
+        stack_size = (element.type == TYPE_OPERATOR) ? (stack_size - 1) : (stack_size + 1);
+        if (stack_size > compiled_ptr->stack_depth)
+        {
+            compiled_ptr->stack_depth = stack_size;
+        }
 
-                dice_result = (dice1 < dice2) ? dice1 : dice2;
+        switch (element.type)
+        {
+        case TYPE_NUMBER:
+            bytecode[index++] = OPCODE_PUSH_CONSTANT;
+            bytecode[index++] = element.subtype;
+            break;
 
-                if (print_steps) {printf("Throwing d20 with disadvantage: {%d, %d} -> >%d<\n", dice1, dice2, dice_result);}
-                is_disadvantage = false;
+        case TYPE_DICE_GROUP:
+            if (element.subtype == 20)
+            {
+                bytecode[index++] = OPCODE_ROLL_D20_GROUP;
+                bytecode[index++] = element.count;
             }
-            else if (side_count == 20)
+            else if (element.count == 1)
             {
-                // d20 logs its result to make detecting nat 1/ nat 20 easy
-                dice_result = simpleRNG_randomUint32InRange(1, side_count);
-                if (print_steps) {printf("Throwing d20 : >%d<\n", dice_result);}
+                bytecode[index++] = OPCODE_ROLL_DIE;
+                bytecode[index++] = element.subtype;
             }
             else
             {
-                dice_result = simpleRNG_randomUint32InRange(1, side_count);
-            }   
-
-            if (parsedElements_arraySetElement(&parsed_formula, i, (ParsedElement_t) {TYPE_NUMBER, dice_result}))
-            {
-                return -5555;
+                bytecode[index++] = OPCODE_ROLL_GROUP;
+                bytecode[index++] = element.subtype;
+                bytecode[index++] = element.count;
             }
+            break;
+
+        default:
+            if (element.subtype == OPERATOR_PLUS) {bytecode[index++] = OPCODE_ADD;}
+            else if (element.subtype == OPERATOR_MINUS) {bytecode[index++] = OPCODE_SUBTRACT;}
+            else {bytecode[index++] = OPCODE_MULTIPLY;}
+            break;
         }
     }
 
-    // Print formula
-    if (print_steps) 
+    bytecode[index++] = OPCODE_END;
+    parsedElements_arrayDeInit(&postfix);
+
+    compiled_ptr->bytecode = bytecode;
+    compiled_ptr->bytecode_length = index;
+    return PELEM_OK;
+}
+
+/**
+ * Run the bytecode of a compiled formula (threaded dispatch : every instruction jumps straight to the next one)
+ * 
+ * @param compiled_ptr 
+ * @param rng_ptr 
+ * @param flags combination of FormulaFlag_t (steps are not printed)
+ * @param result_ptr 
+ */
+ParsedElementError_t private_runBytecode(const CompiledFormula_t *compiled_ptr, simpleRNG_state_t *rng_ptr, uint32_t flags, int32_t *result_ptr)
+{
+    static const void *dispatch_table[OPCODE_COUNT] = {
+        [OPCODE_END] = &&op_end,
+        [OPCODE_PUSH_CONSTANT] = &&op_push_constant,
+        [OPCODE_ROLL_DIE] = &&op_roll_die,
+        [OPCODE_ROLL_GROUP] = &&op_roll_group,
+        [OPCODE_ROLL_D20_GROUP] = &&op_roll_d20_group,
+        [OPCODE_ADD] = &&op_add,
+        [OPCODE_SUBTRACT] = &&op_subtract,
+        [OPCODE_MULTIPLY] = &&op_multiply
+    };
+
+    bool is_advantage = (flags & FORMULA_FLAG_ADVANTAGE) != 0;
+    bool is_disadvantage = (flags & FORMULA_FLAG_DISADVANTAGE) != 0;
+    bool no_flag = false;
+
+    // The stack size is known since compilation : most formulas fit in the local stack
+    int32_t local_number_stack[LOCAL_NUMBER_STACK_SIZE];
+    int32_t *number_stack = local_number_stack;
+    ArenaMark_t arena_mark = {0};
+
+    if (compiled_ptr->stack_depth > LOCAL_NUMBER_STACK_SIZE)
     {
-        parsedElement_printArray(parsed_formula);
-        printf("\n");
+        if (compiled_ptr->arena_ptr != NULL)
+        {
+            arena_mark = arena_getMark(compiled_ptr->arena_ptr);
+        }
+        number_stack = private_allocate(compiled_ptr->arena_ptr, compiled_ptr->stack_depth * (sizeof *number_stack));
+        if (number_stack == NULL)
+        {
+            return PELEM_ERR_ALLOC;
+        }
     }
-    
-    // ---Calculate final result
-    return private_calculateExpression(parsed_formula);
+
+    int32_t *top_ptr = number_stack; // next free slot of the stack
+    const uint32_t *instruction_ptr = compiled_ptr->bytecode;
+
+    #define DISPATCH() goto *dispatch_table[*instruction_ptr++]
+
+    DISPATCH();
+
+op_push_constant:
+    *top_ptr++ = instruction_ptr[0];
+    instruction_ptr++;
+    DISPATCH();
+
+op_roll_die:
+    *top_ptr++ = simpleRNG_randomUint32InRange_r(rng_ptr, 1, instruction_ptr[0]);
+    instruction_ptr++;
+    DISPATCH();
+
+op_roll_group:
+    *top_ptr++ = private_throwDiceGroup(rng_ptr, (ParsedElement_t) {TYPE_DICE_GROUP, instruction_ptr[0], instruction_ptr[1]}, &no_flag, &no_flag, NULL);
+    instruction_ptr += 2;
+    DISPATCH();
+
+op_roll_d20_group:
+    *top_ptr++ = private_throwDiceGroup(rng_ptr, (ParsedElement_t) {TYPE_DICE_GROUP, 20, instruction_ptr[0]}, &is_advantage, &is_disadvantage, NULL);
+    instruction_ptr++;
+    DISPATCH();
+
+op_add:
+    top_ptr--;
+    top_ptr[-1] = top_ptr[-1] + top_ptr[0];
+    DISPATCH();
+
+op_subtract:
+    top_ptr--;
+    top_ptr[-1] = top_ptr[-1] - top_ptr[0];
+    DISPATCH();
+
+op_multiply:
+    top_ptr--;
+    top_ptr[-1] = top_ptr[-1] * top_ptr[0];
+    DISPATCH();
+
+op_end:
+    #undef DISPATCH
+    *result_ptr = top_ptr[-1];
+
+    if (number_stack != local_number_stack)
+    {
+        if (compiled_ptr->arena_ptr != NULL) {arena_restore(compiled_ptr->arena_ptr, arena_mark);}
+        else {free(number_stack);}
+    }
+
+    return PELEM_OK;
+}
+
+/**
+ * Record a formula element in a trace
+ * 
+ * @param element 
+ * @param trace_ptr 
+ */
+void private_recordElement(ParsedElement_t element, RollTrace_t *trace_ptr)
+{
+    switch (element.type)
+    {
+    case TYPE_NUMBER:
+        rollTrace_record(trace_ptr, TRACE_EVENT_NUMBER, element.subtype, 0);
+        break;
+
+    case TYPE_OPERATOR:
+        rollTrace_record(trace_ptr, TRACE_EVENT_OPERATOR, (uint32_t) parsedElements_operatorToChar(element.subtype), 0);
+        break;
+
+    case TYPE_DICE_GROUP:
+        rollTrace_record(trace_ptr, TRACE_EVENT_DICE_GROUP, element.subtype, element.count);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * Record the start of a roll in a trace, with the formula as written
+ * 
+ * @param compiled_ptr 
+ * @param trace_ptr 
+ */
+void private_recordFormula(const CompiledFormula_t *compiled_ptr, RollTrace_t *trace_ptr)
+{
+    rollTrace_record(trace_ptr, TRACE_EVENT_FORMULA, compiled_ptr->infix.current_length, 0);
+
+    for (uint32_t i = 0; i < compiled_ptr->infix.current_length; i++)
+    {
+        private_recordElement(compiled_ptr->infix.array[i], trace_ptr);
+    }
+}
+
+/**
+ * Record a formula as written with the dice of every group right after it, followed by the result of the roll.
+ * The dice are thrown again from the RNG state the roll started from : operands keep their order in the postfix formula,
+ * so walking the formula as written throws the same dice as the roll.
+ * 
+ * @param compiled_ptr 
+ * @param rng_ptr copy of the RNG state the roll started from
+ * @param flags combination of FormulaFlag_t the roll was made with
+ * @param result result of the roll
+ * @param trace_ptr 
+ */
+void private_recordThrownFormula(const CompiledFormula_t *compiled_ptr, simpleRNG_state_t *rng_ptr, uint32_t flags, int32_t result, RollTrace_t *trace_ptr)
+{
+    bool is_advantage = (flags & FORMULA_FLAG_ADVANTAGE) != 0;
+    bool is_disadvantage = (flags & FORMULA_FLAG_DISADVANTAGE) != 0;
+
+    rollTrace_record(trace_ptr, TRACE_EVENT_THROWN_FORMULA, compiled_ptr->infix.current_length, 0);
+
+    for (uint32_t i = 0; i < compiled_ptr->infix.current_length; i++)
+    {
+        ParsedElement_t element = compiled_ptr->infix.array[i];
+
+        private_recordElement(element, trace_ptr);
+        if (element.type == TYPE_DICE_GROUP)
+        {
+            private_throwDiceGroup(rng_ptr, element, &is_advantage, &is_disadvantage, trace_ptr);
+        }
+    }
+
+    rollTrace_record(trace_ptr, TRACE_EVENT_RESULT, (uint32_t) result, 0);
+}
+
+/**
+ * Read the next element (number or dice group) of a formula being evaluated in a single pass
+ * 
+ * @param reader_ptr 
+ * @param element_ptr set to the element read
+ */
+ParsedElementError_t private_readElement(FormulaReader_t *reader_ptr, ParsedElement_t *element_ptr)
+{
+    char current_element[ELEMENT_BUFFER_SIZE] = {0};
+    uint32_t element_length = 0;
+
+    while ((*reader_ptr->position != '\0') && (parsedElements_charToOperator(*reader_ptr->position) == NOT_AN_OPERATOR))
+    {
+        if (element_length >= ELEMENT_BUFFER_SIZE - 2)
+        {
+            return PELEM_ERR_INVALID_INPUT;
+        }
+
+        current_element[element_length] = *reader_ptr->position;
+        element_length++;
+        reader_ptr->position++;
+    }
+
+    return private_parseElement(current_element, element_ptr);
+}
+
+/**
+ * Read and calculate the rest of a formula, as long as its operators have at least the given precedence
+ * (precedence climbing). Dice are thrown as they are read, in the order they are written.
+ * 
+ * @param reader_ptr 
+ * @param min_precedence 
+ * @param result_ptr set to the value of the expression read
+ */
+ParsedElementError_t private_readExpression(FormulaReader_t *reader_ptr, uint32_t min_precedence, int32_t *result_ptr)
+{
+    ParsedElementError_t status = PELEM_OK;
+    int32_t value = 0;
+
+    // Value : (expression), number or dice group
+    if (*reader_ptr->position == '(')
+    {
+        if (reader_ptr->depth >= MAX_NESTING_DEPTH)
+        {
+            return PELEM_ERR_OOB;
+        }
+
+        reader_ptr->position++;
+        reader_ptr->depth++;
+        status = private_readExpression(reader_ptr, 1, &value);
+        reader_ptr->depth--;
+
+        if (status == PELEM_OK)
+        {
+            if (*reader_ptr->position != ')')
+            {
+                return PELEM_ERR_INVALID_INPUT;
+            }
+            reader_ptr->position++;
+        }
+    }
+    else
+    {
+        ParsedElement_t element;
+        status = private_readElement(reader_ptr, &element);
+
+        if (status == PELEM_OK)
+        {
+            if (element.type == TYPE_DICE_GROUP)
+            {
+                value = private_throwDiceGroup(reader_ptr->rng_ptr, element, &reader_ptr->is_advantage, &reader_ptr->is_disadvantage, NULL);
+            }
+            else
+            {
+                value = element.subtype;
+            }
+        }
+    }
+
+    // Binary operators binding at least as tightly as min_precedence
+    while (status == PELEM_OK)
+    {
+        Operator_t op = parsedElements_charToOperator(*reader_ptr->position);
+
+        if ((op != OPERATOR_PLUS) && (op != OPERATOR_MINUS) && (op != OPERATOR_TIMES))
+        {
+            break;
+        }
+
+        uint32_t precedence = private_getOperatorPrecedence(op);
+        if (precedence < min_precedence)
+        {
+            break;
+        }
+
+        // Operands of higher precedence operators on the right are calculated first (left associativity)
+        int32_t right_value = 0;
+        reader_ptr->position++;
+        status = private_readExpression(reader_ptr, precedence + 1, &right_value);
+
+        switch (op)
+        {
+        case OPERATOR_PLUS:
+            value = value + right_value;
+            break;
+
+        case OPERATOR_MINUS:
+            value = value - right_value;
+            break;
+
+        default:
+            value = value * right_value;
+            break;
+        }
+    }
+
+    *result_ptr = value;
+    return status;
+}
+
+/**
+ * Parse, throw and calculate a formula in a single pass, without building any element array.
+ * Returns -6666 if the formula is invalid.
+ * 
+ * @param formula 
+ * @param rng_ptr 
+ * @param flags combination of FormulaFlag_t (steps cannot be printed)
+ */
+int32_t private_calculateSinglePass(const char *formula, simpleRNG_state_t *rng_ptr, uint32_t flags)
+{
+    FormulaReader_t reader = {
+        .position = formula,
+        .rng_ptr = rng_ptr,
+        .is_advantage = (flags & FORMULA_FLAG_ADVANTAGE) != 0,
+        .is_disadvantage = (flags & FORMULA_FLAG_DISADVANTAGE) != 0,
+        .depth = 0
+    };
+    int32_t result;
+
+    if ((private_readExpression(&reader, 1, &result) != PELEM_OK) || (*reader.position != '\0'))
+    {
+        return -6666;
+    }
+
+    return result;
+}
+
+/**
+ * Get the time of the monotonic clock, in nanoseconds
+ */
+uint64_t private_getTimeNs(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return ((uint64_t) time.tv_sec * 1000000000ULL) + (uint64_t) time.tv_nsec;
+}
+
+/**
+ * Compile a formula (see formulaParser_compileInArena()), timing each phase if stats_ptr is not NULL
+ * 
+ * @param formula 
+ * @param compiled_ptr 
+ * @param arena_ptr arena the formula is allocated from, NULL for the heap
+ * @param stats_ptr stats the phase timings are written to, NULL to skip timing
+ */
+ParsedElementError_t private_compile(char *formula, CompiledFormula_t *compiled_ptr, Arena_t *arena_ptr, FormulaStats_t *stats_ptr)
+{
+    uint64_t phase_start_ns = (stats_ptr != NULL) ? private_getTimeNs() : 0;
+    uint64_t phase_end_ns = 0;
+
+    compiled_ptr->arena_ptr = arena_ptr;
+    compiled_ptr->bytecode = NULL;
+    compiled_ptr->bytecode_length = 0;
+    ParsedElementError_t status = parsedElements_arrayInitInArena(&compiled_ptr->infix, arena_ptr);
+    ParsedElementError_t postfix_status = parsedElements_arrayInitInArena(&compiled_ptr->postfix, arena_ptr);
+
+    if (status == PELEM_OK)
+    {
+        status = postfix_status;
+    }
+
+    if (status == PELEM_OK)
+    {
+        status = private_tokenizeFormula(formula, &compiled_ptr->infix);
+    }
+
+    if (stats_ptr != NULL)
+    {
+        phase_end_ns = private_getTimeNs();
+        stats_ptr->tokenize_ns = phase_end_ns - phase_start_ns;
+        phase_start_ns = phase_end_ns;
+    }
+    
+    if (status == PELEM_OK)
+    {
+        status = private_convertToPostfix(compiled_ptr->infix, &compiled_ptr->postfix);
+    }
+
+    if (stats_ptr != NULL)
+    {
+        phase_end_ns = private_getTimeNs();
+        stats_ptr->postfix_ns = phase_end_ns - phase_start_ns;
+        phase_start_ns = phase_end_ns;
+    }
+
+    if (status == PELEM_OK)
+    {
+        status = private_analyzePostfix(compiled_ptr);
+    }
+
+    if (status == PELEM_OK)
+    {
+        status = private_compileBytecode(compiled_ptr);
+    }
+
+    if (stats_ptr != NULL)
+    {
+        stats_ptr->compile_ns = private_getTimeNs() - phase_start_ns;
+    }
+
+    if (status != PELEM_OK)
+    {
+        formulaParser_deInit(compiled_ptr);
+    }
+
+    return status;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Parse a formula and convert it to postfix notation, so that it can be evaluated any number of times
+ * with formulaParser_evaluate().
+ * On success, the compiled formula must be freed with formulaParser_deInit(). On failure, nothing needs to be freed.
+ * 
+ * @param formula 
+ * @param compiled_ptr 
+ */
+ParsedElementError_t formulaParser_compile(char *formula, CompiledFormula_t *compiled_ptr)
+{
+    return formulaParser_compileInArena(formula, compiled_ptr, NULL);
+}
+
+/**
+ * Compile a formula (see formulaParser_compile()) with all its memory allocated from an arena.
+ * Evaluating it then takes its scratch memory from the same arena and gives it back before returning,
+ * so it must not be evaluated by several threads at once. The formula is freed when the arena is reset.
+ * 
+ * @param formula 
+ * @param compiled_ptr 
+ * @param arena_ptr arena the formula is allocated from, NULL for the heap
+ */
+ParsedElementError_t formulaParser_compileInArena(char *formula, CompiledFormula_t *compiled_ptr, Arena_t *arena_ptr)
+{
+    return private_compile(formula, compiled_ptr, arena_ptr, NULL);
+}
+
+/**
+ * Free a compiled formula
+ * 
+ * @param compiled_ptr 
+ */
+void formulaParser_deInit(CompiledFormula_t *compiled_ptr)
+{
+    parsedElements_arrayDeInit(&compiled_ptr->infix);
+    parsedElements_arrayDeInit(&compiled_ptr->postfix);
+
+    if (compiled_ptr->arena_ptr == NULL)
+    {
+        free(compiled_ptr->bytecode);
+    }
+    compiled_ptr->bytecode = NULL;
+    compiled_ptr->bytecode_length = 0;
+    compiled_ptr->dice_count = 0;
+    compiled_ptr->stack_depth = 0;
+}
+
+/**
+ * Throw the dice of a compiled formula and calculate its result. The compiled formula is not modified.
+ * Does not allocate memory unless printing steps or evaluating deeply nested formulas,
+ * and never makes heap calls for formulas compiled in an arena.
+ * Formulas run as bytecode, unless printing steps : the roll is then recorded in a trace (see formulaParser_evaluateTraced()),
+ * which is printed once the result is known. Rolls too big to be traced at once are streamed in chunks of bounded size instead,
+ * their dice being thrown a second time from the same RNG state to print them in the formula.
+ * 
+ * @param compiled_ptr formula compiled with formulaParser_compile()
+ * @param rng_ptr RNG state used to throw the dice
+ * @param flags combination of FormulaFlag_t
+ * @param result_ptr result of the roll, only set on success
+ */
+ParsedElementError_t formulaParser_evaluate(const CompiledFormula_t *compiled_ptr, simpleRNG_state_t *rng_ptr, uint32_t flags, int32_t *result_ptr)
+{
+    if ((flags & FORMULA_FLAG_PRINT_STEPS) == 0)
+    {
+        return private_runBytecode(compiled_ptr, rng_ptr, flags, result_ptr);
+    }
+
+    RollTrace_t trace;
+    ArenaMark_t arena_mark = {0};
+
+    if (compiled_ptr->arena_ptr != NULL)
+    {
+        arena_mark = arena_getMark(compiled_ptr->arena_ptr);
+    }
+
+    // The trace fits the whole roll : formula start, elements, dice, one advantage/disadvantage pair and result
+    uint64_t record_count = (uint64_t) compiled_ptr->infix.current_length + compiled_ptr->dice_count + 3;
+    ParsedElementError_t status = PELEM_ERR_ALLOC;
+
+    if ((record_count <= STEPS_TRACE_MAX_RECORDS) && rollTrace_init(&trace, (uint32_t) record_count, compiled_ptr->arena_ptr))
+    {
+        status = formulaParser_evaluateTraced(compiled_ptr, rng_ptr, flags, &trace, result_ptr);
+        rollTrace_print(&trace, stdout);
+    }
+    else if (rollTrace_initStreamed(&trace, STEPS_STREAM_RECORDS, compiled_ptr->arena_ptr, stdout))
+    {
+        // The roll prints the formula and the d20s, its replay prints the dice of every group
+        simpleRNG_state_t replay_rng = *rng_ptr;
+
+        status = formulaParser_evaluateTraced(compiled_ptr, rng_ptr, flags, &trace, result_ptr);
+        if (status == PELEM_OK)
+        {
+            private_recordThrownFormula(compiled_ptr, &replay_rng, flags, *result_ptr, &trace);
+        }
+        rollTrace_flush(&trace);
+    }
+
+    if (compiled_ptr->arena_ptr != NULL)
+    {
+        arena_restore(compiled_ptr->arena_ptr, arena_mark);
+    }
+    rollTrace_deInit(&trace);
+
+    return status;
+}
+
+/**
+ * Throw the dice of a compiled formula and calculate its result like formulaParser_evaluate(),
+ * recording the formula, every die and the result in a trace. Nothing is printed : the trace is formatted with rollTrace_print().
+ * Walks the postfix formula instead of running the bytecode, so that every die is recorded in the order of the formula.
+ * 
+ * @param compiled_ptr formula compiled with formulaParser_compile()
+ * @param rng_ptr RNG state used to throw the dice
+ * @param flags combination of FormulaFlag_t, FORMULA_FLAG_PRINT_STEPS is ignored
+ * @param trace_ptr trace the roll is recorded in, NULL to record nothing
+ * @param result_ptr result of the roll, only set on success
+ */
+ParsedElementError_t formulaParser_evaluateTraced(const CompiledFormula_t *compiled_ptr, simpleRNG_state_t *rng_ptr, uint32_t flags, RollTrace_t *trace_ptr, int32_t *result_ptr)
+{
+    bool is_advantage = (flags & FORMULA_FLAG_ADVANTAGE) != 0;
+    bool is_disadvantage = (flags & FORMULA_FLAG_DISADVANTAGE) != 0;
+
+    int32_t local_number_stack[LOCAL_NUMBER_STACK_SIZE];
+    int32_t *number_stack = local_number_stack;
+    uint32_t number_stack_size = 0;
+    ArenaMark_t arena_mark = {0};
+
+    if (compiled_ptr->arena_ptr != NULL)
+    {
+        arena_mark = arena_getMark(compiled_ptr->arena_ptr);
+    }
+
+    if (compiled_ptr->stack_depth > LOCAL_NUMBER_STACK_SIZE)
+    {
+        number_stack = private_allocate(compiled_ptr->arena_ptr, compiled_ptr->stack_depth * (sizeof *number_stack));
+        if (number_stack == NULL)
+        {
+            return PELEM_ERR_ALLOC;
+        }
+    }
+
+    if (trace_ptr != NULL)
+    {
+        private_recordFormula(compiled_ptr, trace_ptr);
+    }
+
+    // Evaluate postfix expression, throwing dice as they come
+    for (uint32_t i = 0; i < compiled_ptr->postfix.current_length; i++)
+    {
+        ParsedElement_t element = compiled_ptr->postfix.array[i];
+
+        switch (element.type)
+        {
+        case TYPE_NUMBER:
+            number_stack[number_stack_size] = element.subtype;
+            number_stack_size++;
+            break;
+
+        case TYPE_DICE_GROUP:
+            number_stack[number_stack_size] = private_throwDiceGroup(rng_ptr, element, &is_advantage, &is_disadvantage, trace_ptr);
+            number_stack_size++;
+            break;
+
+        case TYPE_OPERATOR:
+        {
+            // The compiled formula was checked : there are always 2 numbers on the stack here
+            int32_t num1 = number_stack[number_stack_size - 1];
+            int32_t num2 = number_stack[number_stack_size - 2];
+            number_stack_size--;
+
+            switch (element.subtype)
+            {
+            case OPERATOR_PLUS:
+                number_stack[number_stack_size - 1] = num2 + num1;
+                break;
+
+            case OPERATOR_MINUS:
+                number_stack[number_stack_size - 1] = num2 - num1;
+                break;
+
+            case OPERATOR_TIMES:
+                number_stack[number_stack_size - 1] = num2 * num1;
+                break;                
+            
+            default:
+                break;
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    *result_ptr = number_stack[0];
+
+    if (trace_ptr != NULL)
+    {
+        rollTrace_record(trace_ptr, TRACE_EVENT_RESULT, (uint32_t) *result_ptr, 0);
+    }
+
+    if (compiled_ptr->arena_ptr != NULL)
+    {
+        arena_restore(compiled_ptr->arena_ptr, arena_mark);
+    }
+    else if (number_stack != local_number_stack)
+    {
+        free(number_stack);
+    }
+
+    return PELEM_OK;
+}
+
+/**
+ * Get the lowest and highest possible results of a compiled formula.
+ * Returns false if a bound does not fit in 64 bits.
+ * 
+ * @param compiled_ptr formula compiled with formulaParser_compile()
+ * @param min_ptr 
+ * @param max_ptr 
+ */
+bool formulaParser_getBounds(const CompiledFormula_t *compiled_ptr, int64_t *min_ptr, int64_t *max_ptr)
+{
+    int64_t (*bounds_stack)[2] = malloc(compiled_ptr->stack_depth * (sizeof *bounds_stack));
+    uint32_t bounds_stack_size = 0;
+    bool overflow = (bounds_stack == NULL);
+
+    for (uint32_t i = 0; (i < compiled_ptr->postfix.current_length) && !overflow; i++)
+    {
+        ParsedElement_t element = compiled_ptr->postfix.array[i];
+
+        switch (element.type)
+        {
+        case TYPE_NUMBER:
+            bounds_stack[bounds_stack_size][0] = element.subtype;
+            bounds_stack[bounds_stack_size][1] = element.subtype;
+            bounds_stack_size++;
+            break;
+
+        case TYPE_DICE_GROUP:
+            bounds_stack[bounds_stack_size][0] = element.count;
+            bounds_stack[bounds_stack_size][1] = (int64_t) element.count * element.subtype;
+            bounds_stack_size++;
+            break;
+
+        case TYPE_OPERATOR:
+        {
+            int64_t *a = bounds_stack[bounds_stack_size - 2];
+            int64_t *b = bounds_stack[bounds_stack_size - 1];
+            int64_t result[2] = {a[0], a[1]};
+            bounds_stack_size--;
+
+            switch (element.subtype)
+            {
+            case OPERATOR_PLUS:
+                overflow |= __builtin_add_overflow(a[0], b[0], &result[0]);
+                overflow |= __builtin_add_overflow(a[1], b[1], &result[1]);
+                break;
+
+            case OPERATOR_MINUS:
+                overflow |= __builtin_sub_overflow(a[0], b[1], &result[0]);
+                overflow |= __builtin_sub_overflow(a[1], b[0], &result[1]);
+                break;
+
+            case OPERATOR_TIMES:
+                // The extreme products are products of extreme values
+                result[0] = INT64_MAX;
+                result[1] = INT64_MIN;
+                for (uint32_t j = 0; j < 4; j++)
+                {
+                    int64_t product;
+                    overflow |= __builtin_mul_overflow(a[j / 2], b[j % 2], &product);
+                    result[0] = (product < result[0]) ? product : result[0];
+                    result[1] = (product > result[1]) ? product : result[1];
+                }
+                break;
+            
+            default:
+                break;
+            }
+
+            a[0] = result[0];
+            a[1] = result[1];
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    if (!overflow)
+    {
+        *min_ptr = bounds_stack[0][0];
+        *max_ptr = bounds_stack[0][1];
+    }
+
+    free(bounds_stack);
+    return !overflow;
+}
+
+/**
+ * Parse, throw and calculate a formula once, using the RNG state of the calling thread.
+ * Returns -6666 if the formula is invalid or could not be evaluated.
+ * 
+ * @param formula 
+ * @param is_advantage throw first d20 with advantage
+ * @param is_disadvantage throw first d20 with disadvantage
+ * @param print_steps 
+ * @param arena_ptr arena the memory needed to print steps is taken from (it can be reset as soon as this returns), NULL for the heap
+ * @param stats_ptr filled with the timings and counters of each phase (which goes through the compiled path), NULL to skip measuring
+ */
+int32_t formulaParser_calculateFormula(char *formula, bool is_advantage, bool is_disadvantage, bool print_steps, Arena_t *arena_ptr, FormulaStats_t *stats_ptr)
+{
+    CompiledFormula_t compiled_formula;
+
+    uint32_t flags = FORMULA_FLAG_NONE;
+    if (is_advantage) {flags |= FORMULA_FLAG_ADVANTAGE;}
+    if (is_disadvantage) {flags |= FORMULA_FLAG_DISADVANTAGE;}
+
+    // Printing steps and measuring phases need the whole formula, the rest can be done in a single pass
+    if (!print_steps && (stats_ptr == NULL))
+    {
+        return private_calculateSinglePass(formula, simpleRNG_getState(), flags);
+    }
+    if (print_steps) {flags |= FORMULA_FLAG_PRINT_STEPS;}
+
+    ParsedElementCounters_t counters_start = {0};
+    uint64_t allocation_count_start = 0;
+    simpleRNG_state_t rng_start = {0};
+    uint64_t start_ns = 0;
+    if (stats_ptr != NULL)
+    {
+        counters_start = parsedElements_getCounters();
+        allocation_count_start = allocCounter_getCount();
+        rng_start = *simpleRNG_getState();
+        start_ns = private_getTimeNs();
+    }
+
+    int32_t result = -6666;
+    if (private_compile(formula, &compiled_formula, arena_ptr, stats_ptr) == PELEM_OK)
+    {
+        uint64_t evaluate_start_ns = (stats_ptr != NULL) ? private_getTimeNs() : 0;
+
+        if (formulaParser_evaluate(&compiled_formula, simpleRNG_getState(), flags, &result) != PELEM_OK)
+        {
+            result = -6666;
+        }
+
+        if (stats_ptr != NULL)
+        {
+            stats_ptr->evaluate_ns = private_getTimeNs() - evaluate_start_ns;
+        }
+
+        formulaParser_deInit(&compiled_formula);
+    }
+    else if (stats_ptr != NULL)
+    {
+        stats_ptr->evaluate_ns = 0;
+    }
+
+    if (stats_ptr != NULL)
+    {
+        stats_ptr->total_ns = private_getTimeNs() - start_ns;
+        stats_ptr->is_rng_draw_count_known = simpleRNG_getDistance_r(&rng_start, simpleRNG_getState(), &stats_ptr->rng_draw_count);
+        stats_ptr->resize_count = parsedElements_getCounters().resize_count - counters_start.resize_count;
+        stats_ptr->heap_allocation_count = allocCounter_getCount() - allocation_count_start;
+    }
+
+    return result;
+}
+
+/**
+ * Print the stats of a formulaParser_calculateFormula() call to stderr
+ * 
+ * @param stats_ptr 
+ */
+void formulaParser_printStats(const FormulaStats_t *stats_ptr)
+{
+    fprintf(stderr, "Stats :\n");
+    fprintf(stderr, "  tokenize        %10.3f us\n", (double) stats_ptr->tokenize_ns / 1000.0);
+    fprintf(stderr, "  postfix         %10.3f us\n", (double) stats_ptr->postfix_ns / 1000.0);
+    fprintf(stderr, "  compile         %10.3f us\n", (double) stats_ptr->compile_ns / 1000.0);
+    fprintf(stderr, "  evaluate        %10.3f us\n", (double) stats_ptr->evaluate_ns / 1000.0);
+    fprintf(stderr, "  total           %10.3f us\n", (double) stats_ptr->total_ns / 1000.0);
+
+    if (stats_ptr->is_rng_draw_count_known)
+    {
+        fprintf(stderr, "  RNG draws       %10"PRIu64"\n", stats_ptr->rng_draw_count);
+    }
+    else
+    {
+        fprintf(stderr, "  RNG draws       %10s\n", "unknown");
+    }
+    fprintf(stderr, "  array resizes   %10"PRIu64"\n", stats_ptr->resize_count);
+    fprintf(stderr, "  heap allocations %9"PRIu64"\n", stats_ptr->heap_allocation_count);
 }
@@ -3,7 +3,75 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "parsedElements.h"
+#include "simpleRNG.h"
+#include "arena.h"
+#include "rollTrace.h"
 
-int32_t formulaParser_calculateFormula(char *formula, bool is_advantage, bool is_disadvantage, bool print_steps);
+/*---Enums---*/
+
+/// Flags changing how a compiled formula is evaluated. Can be combined with |
+typedef enum
+{
+    FORMULA_FLAG_NONE = 0,
+    FORMULA_FLAG_ADVANTAGE = 1 << 0,    // throw first d20 with advantage
+    FORMULA_FLAG_DISADVANTAGE = 1 << 1, // throw first d20 with disadvantage
+    FORMULA_FLAG_PRINT_STEPS = 1 << 2   // record the roll in a trace and print it once evaluated
+} FormulaFlag_t;
+
+/// Instructions of the formula bytecode. Every opcode is a 32 bit word, followed by its operand words
+typedef enum
+{
+    OPCODE_END,            // return the value on top of the stack
+    OPCODE_PUSH_CONSTANT,  // operand : value
+    OPCODE_ROLL_DIE,       // operand : side count. Throw a single die that cannot be a d20
+    OPCODE_ROLL_GROUP,     // operands : side count, dice count. Throw a group that cannot be d20s
+    OPCODE_ROLL_D20_GROUP, // operand : dice count. Throw d20s, the first ones with advantage/disadvantage while it is still pending
+    OPCODE_ADD,
+    OPCODE_SUBTRACT,
+    OPCODE_MULTIPLY,
+    OPCODE_COUNT
+} FormulaOpcode_t;
+
+/*---Structs---*/
+
+/**
+ * Formula that has been parsed and converted to postfix notation once, and can then be evaluated any number of times.
+ * Must not be modified after formulaParser_compile(), and must be freed with formulaParser_deInit().
+ */
+typedef struct
+{
+    ParsedElementArray_t infix;   // formula in the order it was written, only used to print steps
+    ParsedElementArray_t postfix; // formula in postfix notation, used for analysis and to print steps
+    uint64_t dice_count;          // total number of dice in the TYPE_DICE_GROUP elements of the formula, cannot wrap
+    uint32_t stack_depth;         // size of the number stack needed to evaluate the postfix formula
+    uint32_t *bytecode;           // postfix formula compiled to FormulaOpcode_t instructions, used for evaluation
+    uint32_t bytecode_length;     // number of 32 bit words in bytecode
+    Arena_t *arena_ptr;           // arena the formula and its evaluation scratch memory come from, NULL for the heap
+} CompiledFormula_t;
+
+/// Measures of a single formulaParser_calculateFormula() call. Times are in nanoseconds, from the monotonic clock
+typedef struct
+{
+    uint64_t tokenize_ns;           // reading the formula and expanding its dice groups
+    uint64_t postfix_ns;            // shunting-yard conversion to postfix notation
+    uint64_t compile_ns;            // analysis, optimization and bytecode generation
+    uint64_t evaluate_ns;           // throwing the dice and calculating the result (and printing steps)
+    uint64_t total_ns;
+    uint64_t rng_draw_count;        // numbers drawn from the RNG, only valid if is_rng_draw_count_known
+    bool is_rng_draw_count_known;   // false for generators that cannot tell how far their state moved
+    uint64_t resize_count;          // element array resizes
+    uint64_t heap_allocation_count; // successful malloc/calloc/realloc calls, of every module (see allocCounter.h)
+} FormulaStats_t;
+
+ParsedElementError_t formulaParser_compile(char *formula, CompiledFormula_t *compiled_ptr);
+ParsedElementError_t formulaParser_compileInArena(char *formula, CompiledFormula_t *compiled_ptr, Arena_t *arena_ptr);
+void formulaParser_deInit(CompiledFormula_t *compiled_ptr);
+ParsedElementError_t formulaParser_evaluate(const CompiledFormula_t *compiled_ptr, simpleRNG_state_t *rng_ptr, uint32_t flags, int32_t *result_ptr);
+ParsedElementError_t formulaParser_evaluateTraced(const CompiledFormula_t *compiled_ptr, simpleRNG_state_t *rng_ptr, uint32_t flags, RollTrace_t *trace_ptr, int32_t *result_ptr);
+bool formulaParser_getBounds(const CompiledFormula_t *compiled_ptr, int64_t *min_ptr, int64_t *max_ptr);
+
+int32_t formulaParser_calculateFormula(char *formula, bool is_advantage, bool is_disadvantage, bool print_steps, Arena_t *arena_ptr, FormulaStats_t *stats_ptr);
+void formulaParser_printStats(const FormulaStats_t *stats_ptr);
 
 #endif /* INC_FORMULAPARSER_H */
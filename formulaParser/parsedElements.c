@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 /************************************************************************************************************
  * Macros, enums, structs, variables
@@ -9,6 +10,8 @@
 
 #define DEFAULT_ELEMENT_ARRAY_SIZE 8
 
+static _Thread_local ParsedElementCounters_t counters = {0};
+
 /************************************************************************************************************
  * Private functions
  */
@@ -93,35 +96,97 @@ char parsedElements_operatorToChar(Operator_t op)
 }
 
 /**
- * Initialize a parsed element array (allocate memory)
+ * Get the memory counters of the calling thread
+ */
+ParsedElementCounters_t parsedElements_getCounters(void)
+{
+    return counters;
+}
+
+/**
+ * Initialize a parsed element array (allocate memory). Returns PELEM_ERR_ALLOC if it could not be allocated,
+ * the array is then empty and can still be de-initialized.
  * 
  * @param element_array_ptr
  */
-void parsedElements_arrayInit(ParsedElementArray_t *element_array_ptr)
+ParsedElementError_t parsedElements_arrayInit(ParsedElementArray_t *element_array_ptr)
 {
-    element_array_ptr->array = malloc(DEFAULT_ELEMENT_ARRAY_SIZE * (sizeof *(element_array_ptr->array)));
-    element_array_ptr->max_length = DEFAULT_ELEMENT_ARRAY_SIZE;
+    return parsedElements_arrayInitInArena(element_array_ptr, NULL);
+}
+
+/**
+ * Initialize a parsed element array allocated from an arena. The array memory belongs to the arena :
+ * it is only given back when the arena is reset. Returns PELEM_ERR_ALLOC if it could not be allocated,
+ * the array is then empty and can still be de-initialized.
+ * 
+ * @param element_array_ptr
+ * @param arena_ptr arena the array is allocated from, NULL for the heap
+ */
+ParsedElementError_t parsedElements_arrayInitInArena(ParsedElementArray_t *element_array_ptr, Arena_t *arena_ptr)
+{
+    size_t size = DEFAULT_ELEMENT_ARRAY_SIZE * (sizeof *(element_array_ptr->array));
+
+    element_array_ptr->arena_ptr = arena_ptr;
+    if (arena_ptr != NULL)
+    {
+        element_array_ptr->array = arena_alloc(arena_ptr, size);
+    }
+    else
+    {
+        element_array_ptr->array = malloc(size);
+    }
     element_array_ptr->current_length = 0;
+
+    if (element_array_ptr->array == NULL)
+    {
+        element_array_ptr->max_length = 0;
+        return PELEM_ERR_ALLOC;
+    }
+    element_array_ptr->max_length = DEFAULT_ELEMENT_ARRAY_SIZE;
     
     for (uint32_t i = 0; i < DEFAULT_ELEMENT_ARRAY_SIZE; i++)
     {
         element_array_ptr->array[i].type = TYPE_NONE;
         element_array_ptr->array[i].subtype = 0;
+        element_array_ptr->array[i].count = 0;
     }
+
+    return PELEM_OK;
 }
 
 /**
- * Modify the max number of elements that can be stored in an array (re-allocate memory)
+ * Modify the max number of elements that can be stored in an array (re-allocate memory).
+ * Returns PELEM_ERR_ALLOC if it could not be re-allocated, the array is then left as it was.
  * 
  * @param element_array_ptr 
  * @param new_length 
  */
-void parsedElements_arrayResize(ParsedElementArray_t *element_array_ptr, uint32_t new_length)
+ParsedElementError_t parsedElements_arrayResize(ParsedElementArray_t *element_array_ptr, uint32_t new_length)
 {
     uint32_t old_length = element_array_ptr->max_length;
+    size_t new_size = (size_t) new_length * (sizeof *element_array_ptr->array);
+    ParsedElement_t *new_array;
 
-    element_array_ptr->array = realloc(element_array_ptr->array, new_length * (sizeof *element_array_ptr->array));
-    element_array_ptr->max_length = new_length;
+    counters.resize_count++;
+    if (element_array_ptr->arena_ptr != NULL)
+    {
+        // The old array stays in the arena until it is reset
+        new_array = arena_alloc(element_array_ptr->arena_ptr, new_size);
+        if (new_array != NULL)
+        {
+            memcpy(new_array, element_array_ptr->array, ((old_length < new_length) ? old_length : new_length) * (sizeof *new_array));
+        }
+    }
+    else
+    {
+        new_array = realloc(element_array_ptr->array, new_size);
+    }
+
+    if (new_array == NULL)
+    {
+        return PELEM_ERR_ALLOC;
+    }
+    element_array_ptr->array = new_array;
     
     if (old_length < new_length)
     {
@@ -129,10 +194,12 @@ void parsedElements_arrayResize(ParsedElementArray_t *element_array_ptr, uint32_
         {
             element_array_ptr->array[i].type = TYPE_NONE;
             element_array_ptr->array[i].subtype = 0;
+            element_array_ptr->array[i].count = 0;
         }
     }
 
     element_array_ptr->max_length = new_length;
+    return PELEM_OK;
 }
 
 /**
@@ -142,26 +209,38 @@ void parsedElements_arrayResize(ParsedElementArray_t *element_array_ptr, uint32_
  */
 void parsedElements_arrayDeInit(ParsedElementArray_t *element_array_ptr)
 {
-    free(element_array_ptr->array);
+    if (element_array_ptr->arena_ptr == NULL)
+    {
+        free(element_array_ptr->array);
+    }
+    element_array_ptr->array = NULL;
     element_array_ptr->max_length = 0;
     element_array_ptr->current_length = 0;
 }
 
 /**
- * Append a new element at the end of the array, extending its max length if needed
+ * Append a new element at the end of the array, doubling its max length if needed.
+ * Returns PELEM_ERR_ALLOC if the array could not grow, the element is then not appended.
  * 
  * @param element_array_ptr 
  * @param element 
  */
-void parsedElements_arrayAppend(ParsedElementArray_t *element_array_ptr, ParsedElement_t element)
+ParsedElementError_t parsedElements_arrayAppend(ParsedElementArray_t *element_array_ptr, ParsedElement_t element)
 {
-    if (element_array_ptr->current_length >= element_array_ptr->max_length - 1)
+    if (element_array_ptr->current_length + 1 >= element_array_ptr->max_length)
     {
-        parsedElements_arrayResize(element_array_ptr, element_array_ptr->max_length + DEFAULT_ELEMENT_ARRAY_SIZE);
+        uint32_t new_length = (element_array_ptr->max_length != 0) ? (element_array_ptr->max_length * 2) : DEFAULT_ELEMENT_ARRAY_SIZE;
+        ParsedElementError_t status = parsedElements_arrayResize(element_array_ptr, new_length);
+
+        if (status != PELEM_OK)
+        {
+            return status;
+        }
     }
 
     element_array_ptr->array[element_array_ptr->current_length] = element;
     element_array_ptr->current_length++;
+    return PELEM_OK;
 }
 
 
@@ -195,7 +274,8 @@ void parsedElements_arrayClear(ParsedElementArray_t *element_array_ptr)
     {
         static ParsedElement_t empty_element = {
             .type = TYPE_NONE,
-            .subtype = 0
+            .subtype = 0,
+            .count = 0
         };
 
         // No need to error check here we don't care.
@@ -214,8 +294,8 @@ void parsedElements_printElement(ParsedElement_t element)
 {
     switch (element.type)
     {
-    case TYPE_DICE:
-        printf("d%d ", element.subtype);
+    case TYPE_DICE_GROUP:
+        printf("%dd%d ", element.count, element.subtype);
         break;
     
     case TYPE_NUMBER:
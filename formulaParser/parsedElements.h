@@ -2,12 +2,14 @@
 #define INC_PARSEDELEMENTS_H
 
 #include <stdint.h>
+#include "arena.h"
 
 typedef enum
 {
     PELEM_OK,
     PELEM_ERR_OOB,
-    PELEM_ERR_INVALID_INPUT
+    PELEM_ERR_INVALID_INPUT,
+    PELEM_ERR_ALLOC
 } ParsedElementError_t;
 
 typedef enum
@@ -15,7 +17,7 @@ typedef enum
     TYPE_NONE,
     TYPE_OPERATOR,
     TYPE_NUMBER,
-    TYPE_DICE
+    TYPE_DICE_GROUP
 } ElementType_t;
 
 typedef enum 
@@ -33,7 +35,8 @@ typedef enum
 typedef struct
 {
     ElementType_t type;
-    uint32_t subtype; // operator type for operators, dice face count for dice, number for numbers
+    uint32_t subtype; // operator type for operators, dice face count for dice groups, number for numbers
+    uint32_t count; // number of dice for dice groups, unused otherwise
 } ParsedElement_t;
 
 typedef struct
@@ -41,16 +44,26 @@ typedef struct
     uint32_t max_length;
     uint32_t current_length;
     ParsedElement_t *array;
+    Arena_t *arena_ptr; // arena the array is allocated from, NULL for the heap
 } ParsedElementArray_t;
 
+/// Memory counters of the calling thread, only ever incremented : read them before and after the code to measure
+typedef struct
+{
+    uint64_t resize_count; // calls to parsedElements_arrayResize()
+} ParsedElementCounters_t;
+
 Operator_t parsedElements_charToOperator(char c);
 char parsedElements_operatorToChar(Operator_t op);
 
-void parsedElements_arrayInit(ParsedElementArray_t *element_array_ptr);
-void parsedElements_arrayResize(ParsedElementArray_t *element_array_ptr, uint32_t new_length);
+ParsedElementCounters_t parsedElements_getCounters(void);
+
+ParsedElementError_t parsedElements_arrayInit(ParsedElementArray_t *element_array_ptr);
+ParsedElementError_t parsedElements_arrayInitInArena(ParsedElementArray_t *element_array_ptr, Arena_t *arena_ptr);
+ParsedElementError_t parsedElements_arrayResize(ParsedElementArray_t *element_array_ptr, uint32_t new_length);
 void parsedElements_arrayDeInit(ParsedElementArray_t *element_array_ptr);
 
-void parsedElements_arrayAppend(ParsedElementArray_t *element_array_ptr, ParsedElement_t element);
+ParsedElementError_t parsedElements_arrayAppend(ParsedElementArray_t *element_array_ptr, ParsedElement_t element);
 ParsedElementError_t parsedElements_arraySetElement(ParsedElementArray_t *element_array_ptr, uint32_t index, ParsedElement_t element);
 void parsedElements_arrayClear(ParsedElementArray_t *element_array_ptr);
 
@@ -9,24 +9,59 @@
 #define REQUIRED_ARGS \
         REQUIRED_STRING_ARG(dice_formula, "dice", "Dice formula")
 
+#define OPTIONAL_ARGS \
+        OPTIONAL_ULONG_ARG(roll_count, 1UL, "-n", "count", "Roll the formula count times, printing one result per line") \
+        OPTIONAL_UINT_ARG(thread_count, 0U, "--threads", "k", "Simulate the -n rolls on k threads and print statistics instead of results") \
+        OPTIONAL_UINT_ARG(cache_size, 64U, "--cache-size", "count", "With --stdin or --serve, number of compiled formulas kept in the cache (0 to keep none)") \
+        OPTIONAL_STRING_ARG(socket_path, "", "--serve", "socket", "Serve rolls on a Unix domain socket, one formula per line, until interrupted") \
+        OPTIONAL_STRING_ARG(rng_backend, "lcg", "--rng", "generator", "Random number generator : lcg, xoshiro256** or pcg64") \
+        OPTIONAL_STRING_ARG(output_format, "text", "--output-format", "format", "Format of the -n results : text, or binary (header then int32 or zigzag varints, see outputWriter.h)")
+
 #define BOOLEAN_ARGS \
         BOOLEAN_ARG(help, "-h", "Show help") \
         BOOLEAN_ARG(advantage, "-a", "Throw first d20 with advantage") \
         BOOLEAN_ARG(disadvantage, "-d", "Throw first d20 with disadvantage") \
-        BOOLEAN_ARG(result_only, "-r", "Only print the final result")
+        BOOLEAN_ARG(result_only, "-r", "Only print the final result") \
+        BOOLEAN_ARG(distribution, "--distribution", "Print the exact probability of every result instead of rolling") \
+        BOOLEAN_ARG(use_alias, "--alias", "With -n, precompute the distribution once and draw every result from it") \
+        BOOLEAN_ARG(read_stdin, "--stdin", "Read one formula per line from stdin and print one result per line (or error)") \
+        BOOLEAN_ARG(stats, "--stats", "Print the time taken by each phase of a single roll, its RNG draws and allocations to stderr (with --stdin or --serve : the formula cache hits and misses, once stopped)")
 
 #include "easyargs.h"
 #include <stdio.h>
 #include "simpleRNG.h"
 #include "time.h"
 #include "formulaParser.h"
+#include "formulaCache.h"
+#include "diceDistribution.h"
+#include "aliasTable.h"
+#include "diceSimulation.h"
+#include "rollServer.h"
+#include "outputWriter.h"
 #include <sys/random.h> // For getting good RNG seeds
+#include <unistd.h>
+#include <errno.h>
+
+/*******************************************
+ * Macros
+ */
+
+#define STDIN_BUFFER_SIZE (1 << 16)
+#define STDIN_PLACEHOLDER_FORMULA "-"
 
 /*******************************************
  * Function prototypes
  */
 
 uint64_t getSeed();
+bool moveFormulaFirst(int argc, char *argv[]);
+bool hasArgument(int argc, char *argv[], const char *flag);
+const char *getInvalidCount(int argc, char *argv[], const char *flag);
+int printDistribution(char *formula, uint32_t flags, bool table_only);
+int printSimulation(char *formula, uint32_t flags, unsigned long roll_count, uint32_t thread_count, bool table_only);
+int rollBatch(char *formula, unsigned long roll_count, uint32_t flags, bool use_alias, bool is_binary);
+void rollLine(char *line, uint32_t flags, simpleRNG_state_t *rng_ptr, FormulaCache_t *cache_ptr, OutputWriter_t *writer_ptr);
+int rollStdin(uint32_t flags, uint32_t cache_size, bool print_stats);
 
 /********************************************
  * Main
@@ -34,22 +69,117 @@ uint64_t getSeed();
 
 int main(int argc, char *argv[])
 {
-    simpleRNG_init(getSeed());
-
     args_t args = make_default_args();
+    simpleRNG_backend_t rng_backend;
+    char *stdin_argv[argc + 1];
+    bool has_formula = moveFormulaFirst(argc, argv);
+
+    // Formulas are read from stdin or a socket : give easyargs a placeholder formula
+    if (!has_formula && (hasArgument(argc, argv, "--stdin") || hasArgument(argc, argv, "--serve")))
+    {
+        stdin_argv[0] = argv[0];
+        stdin_argv[1] = STDIN_PLACEHOLDER_FORMULA;
+        memcpy(&stdin_argv[2], &argv[1], (argc - 1) * (sizeof *argv));
+        argv = stdin_argv;
+        argc++;
+        has_formula = true;
+    }
 
     // Parse arguments
-    if (!parse_args(argc, argv, &args) || args.help) {
+    if (!has_formula || !parse_args(argc, argv, &args) || args.help) {
         print_help(argv[0]);
         return 1;
     }
 
+    // easyargs wraps negative counts around and reads text as 0
+    const char *count_flags[] = {"-n", "--threads", "--cache-size"};
+    for (size_t i = 0; i < sizeof count_flags / sizeof *count_flags; i++)
+    {
+        const char *invalid_count = getInvalidCount(argc, argv, count_flags[i]);
+        if (invalid_count != NULL)
+        {
+            fprintf(stderr, "Invalid %s value : %s\n", count_flags[i], invalid_count);
+            return 1;
+        }
+    }
+
+    if (!simpleRNG_getBackendFromName(args.rng_backend, &rng_backend))
+    {
+        fprintf(stderr, "Unknown random number generator : %s\n", args.rng_backend);
+        return 1;
+    }
+
+    bool is_binary = (strcmp(args.output_format, "binary") == 0);
+    if (!is_binary && (strcmp(args.output_format, "text") != 0))
+    {
+        fprintf(stderr, "Unknown output format : %s\n", args.output_format);
+        return 1;
+    }
+
+    if (is_binary && ((args.socket_path[0] != '\0') || args.read_stdin || args.distribution || (args.thread_count != 0)))
+    {
+        fprintf(stderr, "The binary output format only applies to rolls of a single formula (-n)\n");
+        return 1;
+    }
+
+    bool is_cached = (args.socket_path[0] != '\0') || args.read_stdin;
+    bool is_single_roll = !is_cached && !args.distribution && (args.thread_count == 0) && (args.roll_count == 1) && !is_binary;
+    if (args.stats && !is_single_roll && !is_cached)
+    {
+        fprintf(stderr, "Warning: Ignoring '--stats', it only applies to a single roll, --stdin and --serve\n");
+    }
+
+    bool is_batch = !is_cached && !args.distribution && (args.thread_count == 0) && ((args.roll_count != 1) || is_binary);
+    if (args.use_alias && !is_batch)
+    {
+        fprintf(stderr, "Warning: Ignoring '--alias', it only applies to rolls of a single formula with -n\n");
+    }
+
+    simpleRNG_initBackend(rng_backend, getSeed());
+
+    uint32_t flags = FORMULA_FLAG_NONE;
+    if (args.advantage) {flags |= FORMULA_FLAG_ADVANTAGE;}
+    if (args.disadvantage) {flags |= FORMULA_FLAG_DISADVANTAGE;}
+
+    if (args.socket_path[0] != '\0')
+    {
+        FormulaCacheStats_t cache_stats;
+        RollServerError_t status = rollServer_run(args.socket_path, flags, args.cache_size, simpleRNG_getState(), args.stats ? &cache_stats : NULL);
+
+        if ((status == RSERV_OK) && args.stats)
+        {
+            formulaCache_printStats(cache_stats);
+        }
+        return (status == RSERV_OK) ? 0 : 1;
+    }
+
+    if (args.read_stdin)
+    {
+        return rollStdin(flags, args.cache_size, args.stats);
+    }
+
+    if (args.distribution)
+    {
+        return printDistribution(args.dice_formula, flags, args.result_only);
+    }
+
+    if (args.thread_count != 0)
+    {
+        return printSimulation(args.dice_formula, flags, args.roll_count, args.thread_count, args.result_only);
+    }
+
+    if ((args.roll_count != 1) || is_binary)
+    {
+        return rollBatch(args.dice_formula, args.roll_count, flags, args.use_alias, is_binary);
+    }
+
     if (args.result_only == false)
     {
         printf("Processing formula : %s \n", args.dice_formula);
     }
 
-    int32_t result = formulaParser_calculateFormula(args.dice_formula, args.advantage, args.disadvantage, !args.result_only);
+    FormulaStats_t stats;
+    int32_t result = formulaParser_calculateFormula(args.dice_formula, args.advantage, args.disadvantage, !args.result_only, NULL, args.stats ? &stats : NULL);
 
     if (args.result_only == false)
     {
@@ -60,6 +190,12 @@ int main(int argc, char *argv[])
         printf("%d", result);
     }
 
+    if (args.stats)
+    {
+        fflush(stdout);
+        formulaParser_printStats(&stats);
+    }
+
     return 0;
 }
 
@@ -75,4 +211,398 @@ uint64_t getSeed()
         return 0;
     }
     return seed;
-}
\ No newline at end of file
+}
+
+/**
+ * Move the dice formula (first argument that is not an option or an option value) right after the program name,
+ * since easyargs expects required arguments first. This lets options be given before the formula.
+ * Returns false if there is no formula.
+ * 
+ * @param argc 
+ * @param argv 
+ */
+bool moveFormulaFirst(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        // Skip the value of options that take one
+        #define OPTIONAL_ARG(type, name, default, flag, ...) \
+        if (!strcmp(argv[i], flag)) { \
+            i++; \
+            continue; \
+        }
+        OPTIONAL_ARGS
+        #undef OPTIONAL_ARG
+
+        if (argv[i][0] != '-')
+        {
+            char *formula = argv[i];
+            memmove(&argv[2], &argv[1], (i - 1) * (sizeof *argv));
+            argv[1] = formula;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Check if an argument is present on the command line
+ * 
+ * @param argc 
+ * @param argv 
+ * @param flag 
+ */
+bool hasArgument(int argc, char *argv[], const char *flag)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], flag))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Get the value given to a count option that is not an unsigned decimal number, or NULL if every value given is valid
+ * 
+ * @param argc 
+ * @param argv 
+ * @param flag 
+ */
+const char *getInvalidCount(int argc, char *argv[], const char *flag)
+{
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        const char *value = argv[i + 1];
+
+        if (!strcmp(argv[i], flag) && ((value[0] == '\0') || (value[strspn(value, "0123456789")] != '\0')))
+        {
+            return value;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Print the exact probability distribution of a formula
+ * 
+ * @param formula 
+ * @param flags combination of FormulaFlag_t
+ * @param table_only only print values and probabilities
+ */
+int printDistribution(char *formula, uint32_t flags, bool table_only)
+{
+    CompiledFormula_t compiled_formula;
+    DiceDistribution_t distribution;
+
+    if (formulaParser_compile(formula, &compiled_formula) != PELEM_OK)
+    {
+        fprintf(stderr, "Invalid formula : %s\n", formula);
+        return 1;
+    }
+
+    DiceDistributionError_t status = diceDistribution_fromFormula(&compiled_formula, flags, &distribution);
+    formulaParser_deInit(&compiled_formula);
+
+    if (status != DDIST_OK)
+    {
+        fprintf(stderr, "Could not calculate the distribution of %s : %s\n", formula, (status == DDIST_ERR_TOO_LARGE) ? "too many possible results" : "out of memory");
+        return 1;
+    }
+
+    diceDistribution_print(distribution, table_only);
+    diceDistribution_deInit(&distribution);
+    return 0;
+}
+
+/**
+ * Roll a formula many times over several threads and print the statistics of the results
+ * 
+ * @param formula 
+ * @param flags combination of FormulaFlag_t
+ * @param roll_count 
+ * @param thread_count 
+ * @param table_only only print values, counts and frequencies
+ */
+int printSimulation(char *formula, uint32_t flags, unsigned long roll_count, uint32_t thread_count, bool table_only)
+{
+    CompiledFormula_t compiled_formula;
+    DiceSimulationResult_t result;
+
+    if (formulaParser_compile(formula, &compiled_formula) != PELEM_OK)
+    {
+        fprintf(stderr, "Invalid formula : %s\n", formula);
+        return 1;
+    }
+
+    DiceSimulationError_t status = diceSimulation_run(&compiled_formula, flags, roll_count, thread_count, simpleRNG_getState(), &result);
+    formulaParser_deInit(&compiled_formula);
+
+    if (status != DSIM_OK)
+    {
+        fprintf(stderr, "Could not run the simulation of %s : %s\n", formula, (status == DSIM_ERR_THREAD) ? "could not start threads" : "out of memory");
+        return 1;
+    }
+
+    diceSimulation_print(result, table_only);
+    diceSimulation_deInit(&result);
+    return 0;
+}
+
+/**
+ * Compile a formula once and roll it roll_count times, printing one result per line.
+ * Results are formatted into a large buffer written with a few write() calls instead of going through printf.
+ * 
+ * @param formula 
+ * @param roll_count 
+ * @param flags combination of FormulaFlag_t
+ * @param use_alias draw results from an alias table of the formula distribution instead of throwing dice
+ * @param is_binary write a binary header and binary results instead of text (see outputWriter.h)
+ */
+int rollBatch(char *formula, unsigned long roll_count, uint32_t flags, bool use_alias, bool is_binary)
+{
+    CompiledFormula_t compiled_formula;
+    OutputWriter_t writer;
+    simpleRNG_state_t *rng_ptr = simpleRNG_getState();
+    ParsedElementError_t evaluate_status = PELEM_OK;
+
+    if (formulaParser_compile(formula, &compiled_formula) != PELEM_OK)
+    {
+        fprintf(stderr, "Invalid formula : %s\n", formula);
+        return 1;
+    }
+
+    if (outputWriter_init(&writer, STDOUT_FILENO, OUTPUT_WRITER_BUFFER_SIZE) != OWRITE_OK)
+    {
+        fprintf(stderr, "Could not allocate the output buffer\n");
+        formulaParser_deInit(&compiled_formula);
+        return 1;
+    }
+
+    if (is_binary)
+    {
+        int64_t min_value;
+        int64_t max_value;
+
+        // Results are int32 : unknown or bigger bounds are just the int32 ones
+        if (!formulaParser_getBounds(&compiled_formula, &min_value, &max_value) || (min_value < INT32_MIN) || (max_value > INT32_MAX))
+        {
+            min_value = INT32_MIN;
+            max_value = INT32_MAX;
+        }
+
+        outputWriter_beginBinary(&writer, roll_count, (int32_t) min_value, (int32_t) max_value);
+    }
+
+    if (use_alias)
+    {
+        DiceDistribution_t distribution;
+        AliasTable_t alias_table;
+
+        DiceDistributionError_t status = diceDistribution_fromFormula(&compiled_formula, flags, &distribution);
+        formulaParser_deInit(&compiled_formula);
+
+        if (status == DDIST_OK)
+        {
+            status = aliasTable_init(&alias_table, distribution);
+            diceDistribution_deInit(&distribution);
+        }
+
+        if (status != DDIST_OK)
+        {
+            fprintf(stderr, "Could not calculate the distribution of %s : %s\n", formula, (status == DDIST_ERR_TOO_LARGE) ? "too many possible results" : "out of memory");
+            outputWriter_deInit(&writer);
+            return 1;
+        }
+
+        for (unsigned long i = 0; (i < roll_count) && (writer.status == OWRITE_OK); i++)
+        {
+            outputWriter_writeResult(&writer, aliasTable_draw(&alias_table, rng_ptr));
+        }
+
+        aliasTable_deInit(&alias_table);
+    }
+    else
+    {
+        for (unsigned long i = 0; (i < roll_count) && (writer.status == OWRITE_OK) && (evaluate_status == PELEM_OK); i++)
+        {
+            int32_t result;
+
+            evaluate_status = formulaParser_evaluate(&compiled_formula, rng_ptr, flags, &result);
+            if (evaluate_status == PELEM_OK)
+            {
+                outputWriter_writeResult(&writer, result);
+            }
+        }
+
+        formulaParser_deInit(&compiled_formula);
+    }
+
+    OutputWriterError_t status = outputWriter_flush(&writer);
+    outputWriter_deInit(&writer);
+
+    if (status != OWRITE_OK)
+    {
+        perror("write");
+        return 1;
+    }
+
+    if (evaluate_status != PELEM_OK)
+    {
+        fprintf(stderr, "Could not evaluate %s : out of memory\n", formula);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Roll the formula of one line read from stdin, and print its result (or error)
+ * 
+ * @param line formula, without the newline
+ * @param flags combination of FormulaFlag_t
+ * @param rng_ptr 
+ * @param cache_ptr cache of the formulas already compiled
+ * @param writer_ptr output the result is written to
+ */
+void rollLine(char *line, uint32_t flags, simpleRNG_state_t *rng_ptr, FormulaCache_t *cache_ptr, OutputWriter_t *writer_ptr)
+{
+    const CompiledFormula_t *compiled_ptr;
+    int32_t result;
+    size_t length = strlen(line);
+
+    if ((length != 0) && (line[length - 1] == '\r'))
+    {
+        line[length - 1] = '\0';
+    }
+
+    if ((formulaCache_get(cache_ptr, line, &compiled_ptr) != PELEM_OK) || (formulaParser_evaluate(compiled_ptr, rng_ptr, flags, &result) != PELEM_OK))
+    {
+        outputWriter_writeBytes(writer_ptr, "error\n", sizeof "error\n" - 1);
+        return;
+    }
+
+    outputWriter_writeInt32Line(writer_ptr, result);
+}
+
+/**
+ * Read newline-delimited formulas from stdin until end of file, printing one result per line.
+ * Input is read in large blocks and output goes through an output writer, but output is flushed before every blocking read
+ * so that a client waiting for its results never deadlocks.
+ * Compiled formulas are kept in an LRU cache, so repeated formulas are only parsed once.
+ * 
+ * @param flags combination of FormulaFlag_t
+ * @param cache_size max number of compiled formulas kept
+ * @param print_stats print the lookups of the formula cache to stderr once stdin is closed
+ */
+int rollStdin(uint32_t flags, uint32_t cache_size, bool print_stats)
+{
+    simpleRNG_state_t *rng_ptr = simpleRNG_getState();
+    FormulaCache_t cache;
+    OutputWriter_t writer;
+    size_t capacity = STDIN_BUFFER_SIZE;
+    size_t length = 0; // bytes in the buffer not processed yet
+    char *buffer = malloc(capacity + 1); // + 1 to terminate a last line without newline
+    int exit_code = 0;
+
+    if ((buffer == NULL) || (formulaCache_init(&cache, cache_size) != PELEM_OK))
+    {
+        fprintf(stderr, "Could not allocate the input buffer and formula cache\n");
+        free(buffer);
+        return 1;
+    }
+
+    if (outputWriter_init(&writer, STDOUT_FILENO, OUTPUT_WRITER_BUFFER_SIZE) != OWRITE_OK)
+    {
+        fprintf(stderr, "Could not allocate the output buffer\n");
+        formulaCache_deInit(&cache);
+        free(buffer);
+        return 1;
+    }
+
+    while (true)
+    {
+        if (outputWriter_flush(&writer) != OWRITE_OK)
+        {
+            perror("write");
+            exit_code = 1;
+            break;
+        }
+
+        ssize_t read_length = read(STDIN_FILENO, &buffer[length], capacity - length);
+
+        if (read_length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("read");
+            exit_code = 1;
+            break;
+        }
+
+        if (read_length == 0)
+        {
+            break;
+        }
+
+        length += read_length;
+
+        // Roll every complete line
+        char *line = buffer;
+        char *newline;
+        while ((newline = memchr(line, '\n', length - (line - buffer))) != NULL)
+        {
+            *newline = '\0';
+            rollLine(line, flags, rng_ptr, &cache, &writer);
+            line = newline + 1;
+        }
+
+        // Keep the incomplete last line for the next read
+        length -= line - buffer;
+        memmove(buffer, line, length);
+
+        if (length == capacity)
+        {
+            char *new_buffer = realloc(buffer, 2 * capacity + 1);
+            if (new_buffer == NULL)
+            {
+                fprintf(stderr, "Could not allocate the input buffer\n");
+                exit_code = 1;
+                break;
+            }
+
+            buffer = new_buffer;
+            capacity *= 2;
+        }
+    }
+
+    if ((exit_code == 0) && (length != 0))
+    {
+        buffer[length] = '\0';
+        rollLine(buffer, flags, rng_ptr, &cache, &writer);
+    }
+
+    if ((exit_code == 0) && (outputWriter_flush(&writer) != OWRITE_OK))
+    {
+        perror("write");
+        exit_code = 1;
+    }
+
+    if (print_stats)
+    {
+        formulaCache_printStats(formulaCache_getStats(&cache));
+    }
+
+    outputWriter_deInit(&writer);
+    formulaCache_deInit(&cache);
+    free(buffer);
+    return exit_code;
+}
@@ -0,0 +1,333 @@
+#include "outputWriter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+// Every number from 00 to 99, to write two digits per division
+static const char DIGIT_PAIRS[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+#define BINARY_MAGIC "DICEROLL"
+
+// Smallest number with i digits, except 0 so that 0 has 1 digit
+static const uint32_t DIGIT_THRESHOLDS[10] = {
+    0, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+/**
+ * Get the number of decimal digits of a number, without a loop :
+ * the bit length gives an estimation of log10 (1233 / 4096 ~ log10(2)) that is corrected with a single comparison
+ * 
+ * @param value 
+ */
+uint32_t private_getDigitCount(uint32_t value)
+{
+    uint32_t estimation = ((32 - __builtin_clz(value | 1)) * 1233) >> 12;
+
+    return estimation + 1 - (value < DIGIT_THRESHOLDS[estimation]);
+}
+
+/**
+ * Store an unsigned integer in little-endian order, whatever the byte order of the machine
+ * 
+ * @param destination 
+ * @param value 
+ * @param size number of bytes
+ */
+void private_storeLittleEndian(unsigned char *destination, uint64_t value, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        destination[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+/**
+ * Zigzag encode a difference, so that small negative and positive differences both give small numbers
+ * 
+ * @param difference 
+ */
+uint32_t private_zigzagEncode(int32_t difference)
+{
+    return ((uint32_t) difference << 1) ^ (uint32_t) (difference >> 31);
+}
+
+/**
+ * Get the number of bytes of the LEB128 varint of a number
+ * 
+ * @param value 
+ */
+uint32_t private_getVarintSize(uint32_t value)
+{
+    uint32_t size = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+/**
+ * Write bytes to the file descriptor of a writer, retrying partial and interrupted writes.
+ * Nothing is written once a write has failed.
+ * 
+ * @param writer_ptr 
+ * @param bytes 
+ * @param length 
+ */
+OutputWriterError_t private_writeAll(OutputWriter_t *writer_ptr, const char *bytes, size_t length)
+{
+    size_t written = 0;
+
+    while ((written < length) && (writer_ptr->status == OWRITE_OK))
+    {
+        ssize_t write_length = write(writer_ptr->fd, &bytes[written], length - written);
+
+        if (write_length >= 0)
+        {
+            written += write_length;
+        }
+        else if (errno != EINTR)
+        {
+            writer_ptr->status = OWRITE_ERR_WRITE;
+        }
+    }
+
+    return writer_ptr->status;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Format an integer in decimal, without terminating null char. Returns the number of chars written.
+ * 
+ * @param value 
+ * @param destination at least OUTPUT_WRITER_INT32_MAX_LENGTH chars
+ */
+size_t outputWriter_formatInt32(int32_t value, char *destination)
+{
+    bool is_negative = (value < 0);
+    uint32_t magnitude = is_negative ? (0U - (uint32_t) value) : (uint32_t) value;
+    uint32_t digit_count = private_getDigitCount(magnitude);
+
+    *destination = '-';
+    destination += is_negative;
+
+    // Fill from the last digit, two digits at a time
+    char *digit_ptr = destination + digit_count;
+    while (magnitude >= 100)
+    {
+        uint32_t pair = (magnitude % 100) * 2;
+        magnitude /= 100;
+        digit_ptr -= 2;
+        memcpy(digit_ptr, &DIGIT_PAIRS[pair], 2);
+    }
+
+    if (magnitude >= 10)
+    {
+        memcpy(digit_ptr - 2, &DIGIT_PAIRS[magnitude * 2], 2);
+    }
+    else
+    {
+        digit_ptr[-1] = (char) ('0' + magnitude);
+    }
+
+    return digit_count + is_negative;
+}
+
+/**
+ * Initialize a writer with an empty buffer. Returns OWRITE_ERR_ALLOC if it could not be allocated.
+ * 
+ * @param writer_ptr 
+ * @param fd file descriptor the output is written to, it is not closed by outputWriter_deInit()
+ * @param capacity buffer size, at least OUTPUT_WRITER_INT32_MAX_LENGTH + 1
+ */
+OutputWriterError_t outputWriter_init(OutputWriter_t *writer_ptr, int fd, size_t capacity)
+{
+    writer_ptr->fd = fd;
+    writer_ptr->buffer = malloc(capacity);
+    writer_ptr->capacity = capacity;
+    writer_ptr->length = 0;
+    writer_ptr->status = (writer_ptr->buffer != NULL) ? OWRITE_OK : OWRITE_ERR_ALLOC;
+    writer_ptr->format = OUTPUT_FORMAT_TEXT;
+    writer_ptr->center = 0;
+
+    return writer_ptr->status;
+}
+
+/**
+ * Free the buffer of a writer. Its content is lost : flush it before.
+ * 
+ * @param writer_ptr 
+ */
+void outputWriter_deInit(OutputWriter_t *writer_ptr)
+{
+    free(writer_ptr->buffer);
+    writer_ptr->buffer = NULL;
+    writer_ptr->capacity = 0;
+    writer_ptr->length = 0;
+}
+
+/**
+ * Write the whole buffer to the file descriptor
+ * 
+ * @param writer_ptr 
+ */
+OutputWriterError_t outputWriter_flush(OutputWriter_t *writer_ptr)
+{
+    private_writeAll(writer_ptr, writer_ptr->buffer, writer_ptr->length);
+    writer_ptr->length = 0;
+
+    return writer_ptr->status;
+}
+
+/**
+ * Append raw bytes to the output. Blocks too big for the buffer are written directly.
+ * 
+ * @param writer_ptr 
+ * @param bytes 
+ * @param length 
+ */
+OutputWriterError_t outputWriter_writeBytes(OutputWriter_t *writer_ptr, const void *bytes, size_t length)
+{
+    if ((writer_ptr->capacity - writer_ptr->length < length) && (outputWriter_flush(writer_ptr) != OWRITE_OK))
+    {
+        return writer_ptr->status;
+    }
+
+    if (length > writer_ptr->capacity)
+    {
+        return private_writeAll(writer_ptr, bytes, length);
+    }
+
+    memcpy(&writer_ptr->buffer[writer_ptr->length], bytes, length);
+    writer_ptr->length += length;
+    return writer_ptr->status;
+}
+
+/**
+ * Append an integer in decimal followed by a newline to the output
+ * 
+ * @param writer_ptr 
+ * @param value 
+ */
+OutputWriterError_t outputWriter_writeInt32Line(OutputWriter_t *writer_ptr, int32_t value)
+{
+    if ((writer_ptr->capacity - writer_ptr->length < OUTPUT_WRITER_INT32_MAX_LENGTH + 1) && (outputWriter_flush(writer_ptr) != OWRITE_OK))
+    {
+        return writer_ptr->status;
+    }
+
+    char *line = &writer_ptr->buffer[writer_ptr->length];
+    size_t length = outputWriter_formatInt32(value, line);
+    line[length] = '\n';
+    writer_ptr->length += length + 1;
+
+    return writer_ptr->status;
+}
+
+/**
+ * Switch a writer to binary results and write the header (see outputWriter.h).
+ * Results are written as varints if every result between the bounds fits in OUTPUT_WRITER_MAX_VARINT_SIZE bytes, as int32 otherwise.
+ * 
+ * @param writer_ptr writer nothing has been written to
+ * @param result_count number of results that will be written
+ * @param min_value lowest possible result
+ * @param max_value highest possible result
+ */
+OutputWriterError_t outputWriter_beginBinary(OutputWriter_t *writer_ptr, uint64_t result_count, int32_t min_value, int32_t max_value)
+{
+    unsigned char header[OUTPUT_WRITER_HEADER_SIZE] = {0};
+    int32_t center = (int32_t) (((int64_t) min_value + (int64_t) max_value) / 2);
+
+    writer_ptr->format = OUTPUT_FORMAT_INT32;
+    writer_ptr->center = 0;
+
+    // The bounds are the furthest results from the center, with the biggest varints
+    if (((int64_t) max_value - (int64_t) min_value < INT32_MAX)
+        && (private_getVarintSize(private_zigzagEncode(min_value - center)) <= OUTPUT_WRITER_MAX_VARINT_SIZE)
+        && (private_getVarintSize(private_zigzagEncode(max_value - center)) <= OUTPUT_WRITER_MAX_VARINT_SIZE))
+    {
+        writer_ptr->format = OUTPUT_FORMAT_ZIGZAG_VARINT;
+        writer_ptr->center = center;
+    }
+
+    memcpy(header, BINARY_MAGIC, sizeof BINARY_MAGIC - 1);
+    private_storeLittleEndian(&header[8], OUTPUT_WRITER_BINARY_VERSION, 2);
+    private_storeLittleEndian(&header[10], writer_ptr->format, 2);
+    private_storeLittleEndian(&header[12], (uint32_t) writer_ptr->center, 4);
+    private_storeLittleEndian(&header[16], result_count, 8);
+    private_storeLittleEndian(&header[24], (uint32_t) min_value, 4);
+    private_storeLittleEndian(&header[28], (uint32_t) max_value, 4);
+
+    return outputWriter_writeBytes(writer_ptr, header, sizeof header);
+}
+
+/**
+ * Append a result to the output, in the format of the writer
+ * 
+ * @param writer_ptr 
+ * @param value 
+ */
+OutputWriterError_t outputWriter_writeResult(OutputWriter_t *writer_ptr, int32_t value)
+{
+    if ((writer_ptr->capacity - writer_ptr->length < OUTPUT_WRITER_INT32_MAX_LENGTH + 1) && (outputWriter_flush(writer_ptr) != OWRITE_OK))
+    {
+        return writer_ptr->status;
+    }
+
+    unsigned char *output = (unsigned char *) &writer_ptr->buffer[writer_ptr->length];
+
+    switch (writer_ptr->format)
+    {
+    case OUTPUT_FORMAT_INT32:
+        private_storeLittleEndian(output, (uint32_t) value, 4);
+        writer_ptr->length += 4;
+        break;
+
+    case OUTPUT_FORMAT_ZIGZAG_VARINT:
+    {
+        uint32_t encoded = private_zigzagEncode(value - writer_ptr->center);
+        uint32_t size = 0;
+
+        while (encoded >= 0x80)
+        {
+            output[size++] = (unsigned char) (encoded | 0x80);
+            encoded >>= 7;
+        }
+        output[size++] = (unsigned char) encoded;
+        writer_ptr->length += size;
+        break;
+    }
+
+    default:
+        return outputWriter_writeInt32Line(writer_ptr, value);
+    }
+
+    return writer_ptr->status;
+}
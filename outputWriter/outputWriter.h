@@ -0,0 +1,78 @@
+/**
+ * @file outputWriter.h
+ * @author Kezia Marcou
+ * @brief Buffered writer for bulk results, bypassing stdio.
+ * Integers are formatted two digits at a time into a large buffer, which is written to a file descriptor in a few big write() calls.
+ * Must not be mixed with stdio on the same file descriptor without flushing both.
+ * 
+ * Results can also be written in binary : a header of OUTPUT_WRITER_HEADER_SIZE bytes, all fields little-endian :
+ * - 0  : magic "DICEROLL"
+ * - 8  : uint16 version (OUTPUT_WRITER_BINARY_VERSION)
+ * - 10 : uint16 format (OUTPUT_FORMAT_INT32 or OUTPUT_FORMAT_ZIGZAG_VARINT)
+ * - 12 : int32 center
+ * - 16 : uint64 result count
+ * - 24 : int32 min and int32 max, bounds of every result
+ * 
+ * followed by the results, either as int32 (the file can be mapped as an array from the end of the header),
+ * or as LEB128 varints of the zigzag encoded difference between the result and the center, when the bounds are close enough
+ * for every varint to be at most OUTPUT_WRITER_MAX_VARINT_SIZE bytes.
+ *
+ */
+
+#ifndef INC_OUTPUTWRITER_H
+#define INC_OUTPUTWRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// Longest formatted int32 : "-2147483648"
+#define OUTPUT_WRITER_INT32_MAX_LENGTH 11
+
+/// Default buffer size, big enough for write() calls to be rare
+#define OUTPUT_WRITER_BUFFER_SIZE (1 << 20)
+
+#define OUTPUT_WRITER_HEADER_SIZE 32
+#define OUTPUT_WRITER_BINARY_VERSION 1
+#define OUTPUT_WRITER_MAX_VARINT_SIZE 2 // results are only written as varints if it makes them at least twice smaller
+
+typedef enum
+{
+    OWRITE_OK,
+    OWRITE_ERR_ALLOC,
+    OWRITE_ERR_WRITE
+} OutputWriterError_t;
+
+/// Encoding of the results given to outputWriter_writeResult()
+typedef enum
+{
+    OUTPUT_FORMAT_TEXT,          // decimal, one result per line
+    OUTPUT_FORMAT_INT32,         // little-endian int32
+    OUTPUT_FORMAT_ZIGZAG_VARINT  // LEB128 varint of the zigzag encoded result - center
+} OutputFormat_t;
+
+/*---Structs---*/
+
+typedef struct
+{
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t length;              // bytes in the buffer not written yet
+    OutputWriterError_t status; // first write error, every later write fails with it
+    OutputFormat_t format;      // encoding of the results, text until outputWriter_beginBinary()
+    int32_t center;             // value subtracted from the results encoded as varints
+} OutputWriter_t;
+
+size_t outputWriter_formatInt32(int32_t value, char *destination);
+
+OutputWriterError_t outputWriter_init(OutputWriter_t *writer_ptr, int fd, size_t capacity);
+void outputWriter_deInit(OutputWriter_t *writer_ptr);
+OutputWriterError_t outputWriter_flush(OutputWriter_t *writer_ptr);
+
+OutputWriterError_t outputWriter_writeBytes(OutputWriter_t *writer_ptr, const void *bytes, size_t length);
+OutputWriterError_t outputWriter_writeInt32Line(OutputWriter_t *writer_ptr, int32_t value);
+
+OutputWriterError_t outputWriter_beginBinary(OutputWriter_t *writer_ptr, uint64_t result_count, int32_t min_value, int32_t max_value);
+OutputWriterError_t outputWriter_writeResult(OutputWriter_t *writer_ptr, int32_t value);
+
+#endif /* INC_OUTPUTWRITER_H */
@@ -0,0 +1,439 @@
+#define _GNU_SOURCE // accept4, sigaction
+
+#include "rollServer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "formulaParser.h"
+#include "formulaCache.h"
+#include "outputWriter.h"
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+#define EVENT_BUFFER_SIZE 64
+#define LISTEN_BACKLOG 128
+#define RESULT_MAX_LENGTH 12 // "-2147483648\n"
+#define ERROR_RESULT "error\n"
+
+// Every input line is at least 1 char long ("\n") and gives at most RESULT_MAX_LENGTH chars,
+// so the results of a full input buffer always fit in the output buffer
+#define OUTPUT_BUFFER_SIZE (RESULT_MAX_LENGTH * ROLL_SERVER_LINE_SIZE)
+
+typedef struct RollServerClient_s
+{
+    int fd;
+    bool is_discarding;      // the current line is too long : ignore it until its newline
+    bool is_waiting_output;  // results are pending : wait for EPOLLOUT, and stop reading requests until they are sent
+    uint32_t input_length;
+    uint32_t output_length;
+    uint32_t output_sent;
+    struct RollServerClient_s *previous; // list of open clients, to close them when the server stops
+    struct RollServerClient_s *next;
+    char input[ROLL_SERVER_LINE_SIZE];
+    char output[OUTPUT_BUFFER_SIZE];
+} RollServerClient_t;
+
+typedef struct
+{
+    int epoll_fd;
+    uint32_t flags;
+    FormulaCache_t cache;
+    simpleRNG_state_t *rng_ptr;
+    RollServerClient_t *clients;
+} RollServer_t;
+
+static volatile sig_atomic_t is_stopping = 0;
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+void private_stopServer(int signal_number)
+{
+    (void) signal_number;
+    is_stopping = 1;
+}
+
+/**
+ * Roll one formula line and append its result (or error) to the client output
+ * 
+ * @param server_ptr 
+ * @param client_ptr 
+ * @param line formula, without the newline
+ * @param length 
+ */
+void private_rollLine(RollServer_t *server_ptr, RollServerClient_t *client_ptr, char *line, uint32_t length)
+{
+    const CompiledFormula_t *compiled_ptr;
+    int32_t result;
+    char *output = &client_ptr->output[client_ptr->output_length];
+
+    if ((length != 0) && (line[length - 1] == '\r'))
+    {
+        length--;
+    }
+    line[length] = '\0';
+
+    if ((formulaCache_get(&server_ptr->cache, line, &compiled_ptr) != PELEM_OK)
+        || (formulaParser_evaluate(compiled_ptr, server_ptr->rng_ptr, server_ptr->flags, &result) != PELEM_OK))
+    {
+        memcpy(output, ERROR_RESULT, sizeof ERROR_RESULT - 1);
+        client_ptr->output_length += sizeof ERROR_RESULT - 1;
+        return;
+    }
+
+    uint32_t result_length = outputWriter_formatInt32(result, output);
+    output[result_length] = '\n';
+    client_ptr->output_length += result_length + 1;
+}
+
+/**
+ * Roll every complete line in the client input, and keep the incomplete last one for later
+ * 
+ * @param server_ptr 
+ * @param client_ptr 
+ * @param start index of the first new byte in the input
+ */
+void private_rollInput(RollServer_t *server_ptr, RollServerClient_t *client_ptr, uint32_t start)
+{
+    uint32_t line_start = 0;
+
+    for (uint32_t i = start; i < client_ptr->input_length; i++)
+    {
+        if (client_ptr->input[i] != '\n')
+        {
+            continue;
+        }
+
+        if (client_ptr->is_discarding)
+        {
+            client_ptr->is_discarding = false;
+        }
+        else
+        {
+            private_rollLine(server_ptr, client_ptr, &client_ptr->input[line_start], i - line_start);
+        }
+
+        line_start = i + 1;
+    }
+
+    client_ptr->input_length -= line_start;
+    memmove(client_ptr->input, &client_ptr->input[line_start], client_ptr->input_length);
+
+    // Line too long for the buffer : answer now, and drop the rest of it
+    if (client_ptr->input_length == ROLL_SERVER_LINE_SIZE)
+    {
+        if (!client_ptr->is_discarding)
+        {
+            memcpy(&client_ptr->output[client_ptr->output_length], ERROR_RESULT, sizeof ERROR_RESULT - 1);
+            client_ptr->output_length += sizeof ERROR_RESULT - 1;
+            client_ptr->is_discarding = true;
+        }
+        client_ptr->input_length = 0;
+    }
+}
+
+/**
+ * Close a client connection and free it
+ * 
+ * @param server_ptr 
+ * @param client_ptr 
+ */
+void private_closeClient(RollServer_t *server_ptr, RollServerClient_t *client_ptr)
+{
+    if (client_ptr->previous != NULL) {client_ptr->previous->next = client_ptr->next;}
+    else {server_ptr->clients = client_ptr->next;}
+
+    if (client_ptr->next != NULL) {client_ptr->next->previous = client_ptr->previous;}
+
+    epoll_ctl(server_ptr->epoll_fd, EPOLL_CTL_DEL, client_ptr->fd, NULL);
+    close(client_ptr->fd);
+    free(client_ptr);
+}
+
+/**
+ * Send as much pending output as the socket accepts.
+ * Returns false if the connection failed.
+ * 
+ * @param server_ptr 
+ * @param client_ptr 
+ */
+bool private_sendOutput(RollServer_t *server_ptr, RollServerClient_t *client_ptr)
+{
+    while (client_ptr->output_sent < client_ptr->output_length)
+    {
+        ssize_t sent = send(client_ptr->fd, &client_ptr->output[client_ptr->output_sent], client_ptr->output_length - client_ptr->output_sent, MSG_NOSIGNAL);
+
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                break;
+            }
+
+            return false;
+        }
+
+        client_ptr->output_sent += sent;
+    }
+
+    bool is_waiting = (client_ptr->output_sent < client_ptr->output_length);
+
+    if (!is_waiting)
+    {
+        client_ptr->output_sent = 0;
+        client_ptr->output_length = 0;
+    }
+
+    if (is_waiting != client_ptr->is_waiting_output)
+    {
+        struct epoll_event event = {.events = is_waiting ? EPOLLOUT : EPOLLIN, .data.ptr = client_ptr};
+        epoll_ctl(server_ptr->epoll_fd, EPOLL_CTL_MOD, client_ptr->fd, &event);
+        client_ptr->is_waiting_output = is_waiting;
+    }
+
+    return true;
+}
+
+/**
+ * Read the requests of a client, roll them and send the results.
+ * Returns false if the connection was closed or failed.
+ * 
+ * @param server_ptr 
+ * @param client_ptr 
+ */
+bool private_readInput(RollServer_t *server_ptr, RollServerClient_t *client_ptr)
+{
+    ssize_t received = recv(client_ptr->fd, &client_ptr->input[client_ptr->input_length], ROLL_SERVER_LINE_SIZE - client_ptr->input_length, 0);
+
+    if (received == 0)
+    {
+        return false;
+    }
+
+    if (received < 0)
+    {
+        return (errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK);
+    }
+
+    uint32_t start = client_ptr->input_length;
+    client_ptr->input_length += received;
+    private_rollInput(server_ptr, client_ptr, start);
+
+    return private_sendOutput(server_ptr, client_ptr);
+}
+
+/**
+ * Accept every pending connection
+ * 
+ * @param server_ptr 
+ * @param listen_fd 
+ */
+void private_acceptClients(RollServer_t *server_ptr, int listen_fd)
+{
+    while (true)
+    {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return; // EAGAIN (no more pending connections) or an error on a single connection
+        }
+
+        RollServerClient_t *client_ptr = malloc(sizeof *client_ptr);
+        if (client_ptr == NULL)
+        {
+            close(fd);
+            continue;
+        }
+
+        client_ptr->fd = fd;
+        client_ptr->is_discarding = false;
+        client_ptr->is_waiting_output = false;
+        client_ptr->input_length = 0;
+        client_ptr->output_length = 0;
+        client_ptr->output_sent = 0;
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = client_ptr};
+        if (epoll_ctl(server_ptr->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            free(client_ptr);
+            continue;
+        }
+
+        client_ptr->previous = NULL;
+        client_ptr->next = server_ptr->clients;
+        if (server_ptr->clients != NULL) {server_ptr->clients->previous = client_ptr;}
+        server_ptr->clients = client_ptr;
+    }
+}
+
+/**
+ * Create the listening socket, replacing a socket left at the same path by a previous server.
+ * Returns -1 on error.
+ * 
+ * @param socket_path 
+ */
+int private_listen(const char *socket_path)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    struct stat file_info;
+
+    if (strlen(socket_path) >= sizeof address.sun_path)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    if ((lstat(socket_path, &file_info) == 0) && S_ISSOCK(file_info.st_mode))
+    {
+        unlink(socket_path);
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        return -1;
+    }
+
+    if ((bind(listen_fd, (struct sockaddr *) &address, sizeof address) != 0) || (listen(listen_fd, LISTEN_BACKLOG) != 0))
+    {
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Serve rolls on a Unix domain socket until SIGINT or SIGTERM is received.
+ * The socket file is removed when the server stops.
+ * 
+ * @param socket_path 
+ * @param flags combination of FormulaFlag_t, applied to every request
+ * @param cache_size max number of compiled formulas kept
+ * @param rng_ptr RNG state used for every request
+ * @param cache_stats_ptr filled with the lookups of the formula cache once the server has stopped, NULL to skip them
+ */
+RollServerError_t rollServer_run(const char *socket_path, uint32_t flags, uint32_t cache_size, simpleRNG_state_t *rng_ptr, FormulaCacheStats_t *cache_stats_ptr)
+{
+    RollServer_t server = {.flags = flags, .rng_ptr = rng_ptr, .clients = NULL};
+    RollServerError_t status = RSERV_OK;
+    struct epoll_event events[EVENT_BUFFER_SIZE];
+
+    if (formulaCache_init(&server.cache, cache_size) != PELEM_OK)
+    {
+        return RSERV_ERR_ALLOC;
+    }
+
+    int listen_fd = private_listen(socket_path);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = NULL};
+
+    if ((listen_fd < 0) || (server.epoll_fd < 0) || (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event) != 0))
+    {
+        perror("rollServer");
+        if (listen_fd >= 0) {close(listen_fd); unlink(socket_path);}
+        if (server.epoll_fd >= 0) {close(server.epoll_fd);}
+        formulaCache_deInit(&server.cache);
+        return RSERV_ERR_SOCKET;
+    }
+
+    // Stop signals are only delivered while waiting for events, so a stop request can never be missed
+    sigset_t stop_signals;
+    sigset_t wait_signals;
+    struct sigaction stop_action = {.sa_handler = private_stopServer};
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, &wait_signals);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+
+    is_stopping = 0;
+    while (!is_stopping)
+    {
+        int event_count = epoll_pwait(server.epoll_fd, events, EVENT_BUFFER_SIZE, -1, &wait_signals);
+
+        if (event_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("epoll_wait");
+            status = RSERV_ERR_SOCKET;
+            break;
+        }
+
+        for (int i = 0; i < event_count; i++)
+        {
+            RollServerClient_t *client_ptr = events[i].data.ptr;
+
+            if (client_ptr == NULL)
+            {
+                private_acceptClients(&server, listen_fd);
+                continue;
+            }
+
+            bool is_open;
+            if (client_ptr->is_waiting_output)
+            {
+                is_open = ((events[i].events & (EPOLLERR | EPOLLHUP)) == 0) && private_sendOutput(&server, client_ptr);
+            }
+            else
+            {
+                is_open = private_readInput(&server, client_ptr);
+            }
+
+            if (!is_open)
+            {
+                private_closeClient(&server, client_ptr);
+            }
+        }
+    }
+
+    while (server.clients != NULL)
+    {
+        private_closeClient(&server, server.clients);
+    }
+
+    close(server.epoll_fd);
+    close(listen_fd);
+    unlink(socket_path);
+    if (cache_stats_ptr != NULL)
+    {
+        *cache_stats_ptr = formulaCache_getStats(&server.cache);
+    }
+    formulaCache_deInit(&server.cache);
+    sigprocmask(SIG_SETMASK, &wait_signals, NULL);
+
+    return status;
+}
@@ -0,0 +1,32 @@
+/**
+ * @file rollServer.h
+ * @author Kezia Marcou
+ * @brief Roll daemon : a single-process epoll event loop serving many local clients on a Unix domain socket.
+ * Clients send newline-delimited formulas and get one result (or error) per line, in order.
+ * The formula cache and the RNG state are shared by every request.
+ * 
+ * Dependencies :
+ * - Linux (epoll, Unix domain sockets)
+ * 
+ */
+
+#ifndef INC_ROLLSERVER_H
+#define INC_ROLLSERVER_H
+
+#include <stdint.h>
+#include "simpleRNG.h"
+#include "formulaCache.h"
+
+/// Longest formula line accepted, longer lines get an error
+#define ROLL_SERVER_LINE_SIZE 4096
+
+typedef enum
+{
+    RSERV_OK,
+    RSERV_ERR_ALLOC,
+    RSERV_ERR_SOCKET
+} RollServerError_t;
+
+RollServerError_t rollServer_run(const char *socket_path, uint32_t flags, uint32_t cache_size, simpleRNG_state_t *rng_ptr, FormulaCacheStats_t *cache_stats_ptr);
+
+#endif /* INC_ROLLSERVER_H */
@@ -0,0 +1,398 @@
+#define _POSIX_C_SOURCE 200809L // flockfile, putc_unlocked
+
+#include "rollTrace.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "outputWriter.h"
+
+/************************************************************************************************************
+ * Macros, enums, structs, variables
+ */
+
+#define MIN_CAPACITY 16
+#define MAX_CAPACITY (1U << 31)
+
+/************************************************************************************************************
+ * Private functions
+ */
+
+/**
+ * Get a record from its index since the trace was cleared. It must still be in the ring.
+ * 
+ * @param trace_ptr 
+ * @param index 
+ */
+const RollTraceRecord_t *private_getRecord(const RollTrace_t *trace_ptr, uint64_t index)
+{
+    return &trace_ptr->records[index & (trace_ptr->capacity - 1)];
+}
+
+/**
+ * Print a number followed by a space. The stream must be locked.
+ * 
+ * @param stream 
+ * @param value 
+ */
+void private_printNumber(FILE *stream, int32_t value)
+{
+    char buffer[OUTPUT_WRITER_INT32_MAX_LENGTH];
+    size_t length = outputWriter_formatInt32(value, buffer);
+
+    for (size_t i = 0; i < length; i++)
+    {
+        putc_unlocked(buffer[i], stream);
+    }
+    putc_unlocked(' ', stream);
+}
+
+/**
+ * Print a formula element record as written in the formula. The stream must be locked.
+ * 
+ * @param stream 
+ * @param record_ptr 
+ */
+void private_printElement(FILE *stream, const RollTraceRecord_t *record_ptr)
+{
+    switch (record_ptr->type)
+    {
+    case TRACE_EVENT_NUMBER:
+        private_printNumber(stream, (int32_t) record_ptr->value0);
+        break;
+
+    case TRACE_EVENT_OPERATOR:
+        putc_unlocked((char) record_ptr->value0, stream);
+        putc_unlocked(' ', stream);
+        break;
+
+    case TRACE_EVENT_DICE_GROUP:
+        fprintf(stream, "%" PRIu32 "d%" PRIu32 " ", record_ptr->value1, record_ptr->value0);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * Print the line of a d20 thrown with advantage or disadvantage. The stream must be locked.
+ * 
+ * @param stream 
+ * @param pair_ptr TRACE_EVENT_ADVANTAGE or TRACE_EVENT_DISADVANTAGE record
+ * @param kept_value result of the kept die
+ */
+void private_printPair(FILE *stream, const RollTraceRecord_t *pair_ptr, uint32_t kept_value)
+{
+    fprintf(stream, "Throwing d20 with %s: {%" PRIu32 ", %" PRIu32 "} -> >%" PRIu32 "<\n",
+            (pair_ptr->type == TRACE_EVENT_ADVANTAGE) ? "advantage" : "disadvantage", pair_ptr->value0, pair_ptr->value1, kept_value);
+}
+
+/**
+ * Print formula element records as written in the formula, each dice group being replaced by the sum of its dice if dice are given.
+ * The stream must be locked.
+ * 
+ * @param trace_ptr 
+ * @param stream 
+ * @param start index of the first element record
+ * @param end index after the last element record
+ * @param dice_index index of the first die record of the roll, or UINT64_MAX to print the groups themselves
+ */
+void private_printElements(const RollTrace_t *trace_ptr, FILE *stream, uint64_t start, uint64_t end, uint64_t dice_index)
+{
+    for (uint64_t i = start; i < end; i++)
+    {
+        const RollTraceRecord_t *record_ptr = private_getRecord(trace_ptr, i);
+
+        if ((record_ptr->type != TRACE_EVENT_DICE_GROUP) || (dice_index == UINT64_MAX))
+        {
+            private_printElement(stream, record_ptr);
+            continue;
+        }
+
+        fputs("( ", stream);
+        for (uint32_t j = 0; j < record_ptr->value1; j++)
+        {
+            // Advantage pairs are followed by the kept die
+            while (private_getRecord(trace_ptr, dice_index)->type != TRACE_EVENT_DIE)
+            {
+                dice_index++;
+            }
+
+            if (j != 0) {fputs("+ ", stream);}
+            private_printNumber(stream, (int32_t) private_getRecord(trace_ptr, dice_index)->value1);
+            dice_index++;
+        }
+        fputs(") ", stream);
+    }
+}
+
+/**
+ * Print the next record of a streamed trace, from the position kept in its state. The stream must be locked.
+ * A roll prints its formula and its d20s, a thrown formula prints the formula with every dice group replaced by its dice.
+ * 
+ * @param trace_ptr 
+ * @param record_ptr 
+ */
+void private_printStreamed(RollTrace_t *trace_ptr, const RollTraceRecord_t *record_ptr)
+{
+    RollTraceStreamState_t *state_ptr = &trace_ptr->state;
+    FILE *stream = trace_ptr->stream;
+
+    switch (record_ptr->type)
+    {
+    case TRACE_EVENT_FORMULA:
+    case TRACE_EVENT_THROWN_FORMULA:
+        state_ptr->element_count = record_ptr->value0;
+        state_ptr->is_thrown_formula = (record_ptr->type == TRACE_EVENT_THROWN_FORMULA);
+        state_ptr->has_pair = false;
+        break;
+
+    case TRACE_EVENT_NUMBER:
+    case TRACE_EVENT_OPERATOR:
+    case TRACE_EVENT_DICE_GROUP:
+        if (state_ptr->element_count == 0)
+        {
+            break;
+        }
+        state_ptr->element_count--;
+
+        if (state_ptr->is_thrown_formula && (record_ptr->type == TRACE_EVENT_DICE_GROUP))
+        {
+            fputs("( ", stream);
+            state_ptr->dice_count = record_ptr->value1;
+            state_ptr->die_index = 0;
+        }
+        else
+        {
+            private_printElement(stream, record_ptr);
+        }
+
+        if (!state_ptr->is_thrown_formula && (state_ptr->element_count == 0))
+        {
+            fputs("\n---Throwing dice---\n", stream);
+        }
+        break;
+
+    case TRACE_EVENT_ADVANTAGE:
+    case TRACE_EVENT_DISADVANTAGE:
+        state_ptr->pair = *record_ptr;
+        state_ptr->has_pair = true;
+        break;
+
+    case TRACE_EVENT_DIE:
+        if (state_ptr->is_thrown_formula)
+        {
+            if (state_ptr->die_index != 0) {fputs("+ ", stream);}
+            private_printNumber(stream, (int32_t) record_ptr->value1);
+
+            state_ptr->die_index++;
+            if (state_ptr->die_index == state_ptr->dice_count) {fputs(") ", stream);}
+        }
+        else if (state_ptr->has_pair)
+        {
+            private_printPair(stream, &state_ptr->pair, record_ptr->value1);
+            state_ptr->has_pair = false;
+        }
+        else if (record_ptr->value0 == 20)
+        {
+            // d20s log their result to make detecting nat 1/ nat 20 easy
+            fprintf(stream, "Throwing d20 : >%" PRIu32 "<\n", record_ptr->value1);
+        }
+        break;
+
+    case TRACE_EVENT_RESULT:
+        if (state_ptr->is_thrown_formula) {putc_unlocked('\n', stream);}
+        break;
+
+    default:
+        break;
+    }
+}
+
+/************************************************************************************************************
+ * Public functions
+ */
+
+/**
+ * Initialize an empty trace. Returns false if its records could not be allocated.
+ * 
+ * @param trace_ptr 
+ * @param capacity number of records kept, rounded up to a power of 2
+ * @param arena_ptr arena the records are allocated from (they belong to it), NULL for the heap
+ */
+bool rollTrace_init(RollTrace_t *trace_ptr, uint32_t capacity, Arena_t *arena_ptr)
+{
+    uint32_t rounded_capacity = MIN_CAPACITY;
+    while ((rounded_capacity < capacity) && (rounded_capacity < MAX_CAPACITY))
+    {
+        rounded_capacity <<= 1;
+    }
+
+    size_t size = rounded_capacity * (sizeof *(trace_ptr->records));
+
+    trace_ptr->records = (arena_ptr != NULL) ? arena_alloc(arena_ptr, size) : malloc(size);
+    trace_ptr->capacity = rounded_capacity;
+    trace_ptr->record_count = 0;
+    trace_ptr->arena_ptr = arena_ptr;
+    trace_ptr->stream = NULL;
+    trace_ptr->printed_count = 0;
+    trace_ptr->state = (RollTraceStreamState_t) {0};
+
+    return trace_ptr->records != NULL;
+}
+
+/**
+ * Initialize an empty streamed trace : once full, its records are printed to the stream as they come
+ * (see rollTrace_flush()) instead of being overwritten. Returns false if its records could not be allocated.
+ * 
+ * @param trace_ptr 
+ * @param capacity number of records printed at once, rounded up to a power of 2
+ * @param arena_ptr arena the records are allocated from (they belong to it), NULL for the heap
+ * @param stream 
+ */
+bool rollTrace_initStreamed(RollTrace_t *trace_ptr, uint32_t capacity, Arena_t *arena_ptr, FILE *stream)
+{
+    bool is_allocated = rollTrace_init(trace_ptr, capacity, arena_ptr);
+
+    trace_ptr->stream = stream;
+    return is_allocated;
+}
+
+/**
+ * Free the records of a trace
+ * 
+ * @param trace_ptr 
+ */
+void rollTrace_deInit(RollTrace_t *trace_ptr)
+{
+    if (trace_ptr->arena_ptr == NULL)
+    {
+        free(trace_ptr->records);
+    }
+    trace_ptr->records = NULL;
+    trace_ptr->capacity = 0;
+    trace_ptr->record_count = 0;
+}
+
+/**
+ * Forget every record of a trace, including the records of a streamed trace not printed yet
+ * 
+ * @param trace_ptr 
+ */
+void rollTrace_clear(RollTrace_t *trace_ptr)
+{
+    trace_ptr->record_count = 0;
+    trace_ptr->printed_count = 0;
+    trace_ptr->state = (RollTraceStreamState_t) {0};
+}
+
+/**
+ * Add a record to a trace. If it is full, the oldest record is overwritten, or a streamed trace is flushed.
+ * 
+ * @param trace_ptr 
+ * @param type 
+ * @param value0 see RollTraceEvent_t
+ * @param value1 see RollTraceEvent_t
+ */
+void rollTrace_record(RollTrace_t *trace_ptr, RollTraceEvent_t type, uint32_t value0, uint32_t value1)
+{
+    if ((trace_ptr->stream != NULL) && (trace_ptr->record_count - trace_ptr->printed_count == trace_ptr->capacity))
+    {
+        rollTrace_flush(trace_ptr);
+    }
+
+    RollTraceRecord_t *record_ptr = &trace_ptr->records[trace_ptr->record_count & (trace_ptr->capacity - 1)];
+
+    record_ptr->type = type;
+    record_ptr->value0 = value0;
+    record_ptr->value1 = value1;
+    trace_ptr->record_count++;
+}
+
+/**
+ * Format the rolls of a trace, as the formula, the d20s thrown and the formula with every dice group replaced by its dice.
+ * A roll whose first records were overwritten is skipped, a roll still in progress is printed up to its last die.
+ * The stream is locked once for the whole trace.
+ * 
+ * @param trace_ptr 
+ * @param stream 
+ */
+void rollTrace_print(const RollTrace_t *trace_ptr, FILE *stream)
+{
+    uint64_t end = trace_ptr->record_count;
+    uint64_t i = (end > trace_ptr->capacity) ? (end - trace_ptr->capacity) : 0;
+
+    flockfile(stream);
+
+    while ((i < end) && (private_getRecord(trace_ptr, i)->type != TRACE_EVENT_FORMULA))
+    {
+        i++;
+    }
+
+    if (i != 0)
+    {
+        fprintf(stream, "(%" PRIu64 " older trace records overwritten)\n", i);
+    }
+
+    while (i < end)
+    {
+        uint64_t element_start = i + 1;
+        uint64_t element_end = element_start + private_getRecord(trace_ptr, i)->value0;
+
+        if (element_end > end)
+        {
+            break;
+        }
+
+        private_printElements(trace_ptr, stream, element_start, element_end, UINT64_MAX);
+        fputs("\n---Throwing dice---\n", stream);
+
+        // d20s log their result to make detecting nat 1/ nat 20 easy
+        for (i = element_end; (i < end) && (private_getRecord(trace_ptr, i)->type != TRACE_EVENT_RESULT); i++)
+        {
+            const RollTraceRecord_t *record_ptr = private_getRecord(trace_ptr, i);
+
+            if (((record_ptr->type == TRACE_EVENT_ADVANTAGE) || (record_ptr->type == TRACE_EVENT_DISADVANTAGE)) && (i + 1 < end))
+            {
+                private_printPair(stream, record_ptr, private_getRecord(trace_ptr, i + 1)->value1);
+                i++;
+            }
+            else if ((record_ptr->type == TRACE_EVENT_DIE) && (record_ptr->value0 == 20))
+            {
+                fprintf(stream, "Throwing d20 : >%" PRIu32 "<\n", record_ptr->value1);
+            }
+        }
+
+        if (i == end)
+        {
+            break;
+        }
+
+        private_printElements(trace_ptr, stream, element_start, element_end, element_end);
+        putc_unlocked('\n', stream);
+        i++;
+    }
+
+    funlockfile(stream);
+}
+
+/**
+ * Print the records of a streamed trace that have not been printed yet. Does nothing for other traces.
+ * The stream is locked once for the whole chunk.
+ * 
+ * @param trace_ptr 
+ */
+void rollTrace_flush(RollTrace_t *trace_ptr)
+{
+    if (trace_ptr->stream == NULL)
+    {
+        return;
+    }
+
+    flockfile(trace_ptr->stream);
+    for (; trace_ptr->printed_count < trace_ptr->record_count; trace_ptr->printed_count++)
+    {
+        private_printStreamed(trace_ptr, private_getRecord(trace_ptr, trace_ptr->printed_count));
+    }
+    funlockfile(trace_ptr->stream);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file rollTrace.h
+ * @author Kezia Marcou
+ * @brief Ring buffer of roll events (formula elements, dice, advantage pairs, results), recorded as fixed-size binary records
+ * while rolling and only formatted as text once the rolls are done, or whenever the trace is printed.
+ * Once full, the oldest records are overwritten, so a trace can stay on for any number of rolls.
+ * A streamed trace is printed in chunks whenever it is full instead, so that rolls of any size can be printed with bounded memory.
+ *
+ */
+
+#ifndef INC_ROLLTRACE_H
+#define INC_ROLLTRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "arena.h"
+
+typedef enum
+{
+    TRACE_EVENT_FORMULA,         // start of a roll, value0 : number of element records that follow
+    TRACE_EVENT_NUMBER,          // formula element, value0 : number
+    TRACE_EVENT_OPERATOR,        // formula element, value0 : operator char
+    TRACE_EVENT_DICE_GROUP,      // formula element, value0 : side count, value1 : dice count
+    TRACE_EVENT_ADVANTAGE,       // d20 thrown with advantage, value0 and value1 : both dice (the kept one is the next TRACE_EVENT_DIE)
+    TRACE_EVENT_DISADVANTAGE,    // d20 thrown with disadvantage, value0 and value1 : both dice (the kept one is the next TRACE_EVENT_DIE)
+    TRACE_EVENT_DIE,             // die of a dice group, value0 : side count, value1 : result
+    TRACE_EVENT_RESULT,          // end of a roll, value0 : result (int32)
+    TRACE_EVENT_THROWN_FORMULA   // start of a formula recorded with the dice of every group right after it (only printed by streamed traces),
+                                 // value0 : number of element records that follow, dice records excluded
+} RollTraceEvent_t;
+
+/*---Structs---*/
+
+typedef struct
+{
+    RollTraceEvent_t type;
+    uint32_t value0;
+    uint32_t value1;
+} RollTraceRecord_t;
+
+/// Position of a streamed trace in the records it prints, kept between chunks
+typedef struct
+{
+    uint32_t element_count; // element records left in the formula
+    uint32_t dice_count;    // dice in the current group of a thrown formula
+    uint32_t die_index;     // dice of that group already printed
+    bool is_thrown_formula;
+    bool has_pair;          // an advantage/disadvantage pair waits for its kept die
+    RollTraceRecord_t pair;
+} RollTraceStreamState_t;
+
+typedef struct
+{
+    RollTraceRecord_t *records;
+    uint32_t capacity;             // power of 2
+    uint64_t record_count;         // records written since the trace was cleared, the last capacity ones are kept
+    Arena_t *arena_ptr;            // arena the records are allocated from, NULL for the heap
+    FILE *stream;                  // stream a streamed trace is printed to, NULL for a ring
+    uint64_t printed_count;        // records already printed to stream
+    RollTraceStreamState_t state;
+} RollTrace_t;
+
+bool rollTrace_init(RollTrace_t *trace_ptr, uint32_t capacity, Arena_t *arena_ptr);
+bool rollTrace_initStreamed(RollTrace_t *trace_ptr, uint32_t capacity, Arena_t *arena_ptr, FILE *stream);
+void rollTrace_deInit(RollTrace_t *trace_ptr);
+void rollTrace_clear(RollTrace_t *trace_ptr);
+
+void rollTrace_record(RollTrace_t *trace_ptr, RollTraceEvent_t type, uint32_t value0, uint32_t value1);
+void rollTrace_print(const RollTrace_t *trace_ptr, FILE *stream);
+void rollTrace_flush(RollTrace_t *trace_ptr);
+
+#endif /* INC_ROLLTRACE_H */
@@ -1,5 +1,13 @@
 #include "simpleRNG.h"
 
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SIMPLERNG_HAS_AVX2_FILL
+#endif
+
 /************************************************************************************************************
  * Private macros, typedefs and variables
  */
@@ -10,183 +18,1175 @@
 
 #define RNG_ADD_CONSTANT 696969696969UL
 
-/// Current RNG number, used to generate the next one. Internal to lib.
-static uint64_t current_number = 0;
+// PCG64 (XSL RR 128/64) constants, from https://www.pcg-random.org
+#define PCG_MULT_CONSTANT (((unsigned __int128) 0x2360ED051FC65DA4UL << 64) | 0x4385DF649FCCF645UL)
+#define PCG_DEFAULT_INCREMENT (((unsigned __int128) 0x5851F42D4C957F2DUL << 64) | 0x14057B7EF767814FUL)
+
+#define LCG_STREAM_LENGTH (1UL << 48) // numbers per LCG stream : 2^16 streams
+
+#define BINOMIAL_INVERSION_MAX_MEAN 30.0 // binomials with a lower mean are drawn by inversion, others with BTPE
+
+#define FILL_LANE_COUNT 4 // number of interleaved LCG lanes used to fill buffers (4 x 64 bits = one AVX2 vector)
+#define FILL_MAX_RANGE (1U << 16) // bigger ranges are filled one number at a time, since rejections are not rare anymore
+#define FILL_REJECTED 0xFFFFFFFFU // marks numbers to draw again (never a valid offset, thanks to FILL_MAX_RANGE)
+
+/// State used by the functions without _r suffix. Internal to lib.
+/// Every thread has its own, so threads seeded differently generate independent streams.
+static _Thread_local simpleRNG_state_t default_state = {0};
 
 /************************************************************************************************************
  * Private functions
  */
 
-static uint64_t private_getNextNumber()
+static uint64_t private_rotateLeft(uint64_t x, uint32_t shift)
+{
+    return (x << shift) | (x >> ((64 - shift) & 63));
+}
+
+/**
+ * SplitMix64, used to turn a 64 bit seed into well mixed state words
+ * 
+ * @param seed_ptr updated
+ */
+static uint64_t private_splitMix64(uint64_t *seed_ptr)
+{
+    uint64_t z = (*seed_ptr += 0x9E3779B97F4A7C15UL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * xoshiro256** step, from https://prng.di.unimi.it
+ * 
+ * @param state_ptr
+ */
+static uint64_t private_getNextXoshiro(simpleRNG_state_t *state_ptr)
+{
+    uint64_t *s = state_ptr->xoshiro;
+    uint64_t result = private_rotateLeft(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = private_rotateLeft(s[3], 45);
+
+    return result;
+}
+
+/**
+ * PCG64 step : 128 bit LCG, output with XSL RR (xor of both halves, randomly rotated)
+ * 
+ * @param state_ptr
+ */
+static uint64_t private_getNextPcg(simpleRNG_state_t *state_ptr)
+{
+    unsigned __int128 state = state_ptr->pcg.state * PCG_MULT_CONSTANT + state_ptr->pcg.increment;
+    state_ptr->pcg.state = state;
+
+    uint64_t xored = (uint64_t) (state >> 64) ^ (uint64_t) state;
+    uint32_t rotation = (uint32_t) (state >> 122);
+    return (xored >> rotation) | (xored << ((64 - rotation) & 63));
+}
+
+static uint64_t private_getNextNumber(simpleRNG_state_t *state_ptr)
+{
+    switch (state_ptr->backend)
+    {
+    case SIMPLERNG_BACKEND_XOSHIRO256SS:
+        return private_getNextXoshiro(state_ptr);
+        break;
+
+    case SIMPLERNG_BACKEND_PCG64:
+        return private_getNextPcg(state_ptr);
+        break;
+
+    default:
+        state_ptr->current_number = state_ptr->current_number * RNG_MULT_CONSTANT + RNG_ADD_CONSTANT;
+        return state_ptr->current_number;
+        break;
+    }
+}
+
+/**
+ * Get a uniform random number in [0, range - 1] without division (Lemire's multiply-shift method).
+ * The high half of random * range is uniform, except for the few random numbers whose low half is under 2^32 % range :
+ * those are rejected. The (slow) % is only needed when the low half is under range, which is rare for dice.
+ * 
+ * @param state_ptr
+ * @param range number of possible results, 0 means 2^32
+ */
+static uint32_t private_getBoundedUint32(simpleRNG_state_t *state_ptr, uint32_t range)
+{
+    if (range == 0)
+    {
+        return (uint32_t) (private_getNextNumber(state_ptr) >> 32);
+    }
+
+    uint64_t product = (uint64_t) (private_getNextNumber(state_ptr) >> 32) * range;
+
+    if ((uint32_t) product < range)
+    {
+        uint32_t threshold = (0U - range) % range; // 2^32 % range
+
+        while ((uint32_t) product < threshold)
+        {
+            product = (uint64_t) (private_getNextNumber(state_ptr) >> 32) * range;
+        }
+    }
+
+    return (uint32_t) (product >> 32);
+}
+
+/**
+ * Get a uniform random number in [0, range - 1] without division (Lemire's multiply-shift method, on 64 bits).
+ * 
+ * @param state_ptr
+ * @param range number of possible results, 0 means 2^64
+ */
+static uint64_t private_getBoundedUint64(simpleRNG_state_t *state_ptr, uint64_t range)
+{
+    if (range == 0)
+    {
+        return private_getNextNumber(state_ptr);
+    }
+
+    unsigned __int128 product = (unsigned __int128) private_getNextNumber(state_ptr) * range;
+
+    if ((uint64_t) product < range)
+    {
+        uint64_t threshold = (0UL - range) % range; // 2^64 % range
+
+        while ((uint64_t) product < threshold)
+        {
+            product = (unsigned __int128) private_getNextNumber(state_ptr) * range;
+        }
+    }
+
+    return (uint64_t) (product >> 64);
+}
+
+/**
+ * Get the affine map x -> mult*x + add equivalent to step_count steps of the generator.
+ * Every step is the affine map x -> a*x + c, so step_count steps are the affine map raised to the power step_count,
+ * calculated by repeated squaring in O(log step_count).
+ * 
+ * @param step_count
+ * @param mult_ptr
+ * @param add_ptr
+ */
+static void private_getJumpMap(uint64_t step_count, uint64_t *mult_ptr, uint64_t *add_ptr)
+{
+    // Affine map of the jump (starts as identity), and of 2^i steps
+    uint64_t jump_mult = 1;
+    uint64_t jump_add = 0;
+    uint64_t step_mult = RNG_MULT_CONSTANT;
+    uint64_t step_add = RNG_ADD_CONSTANT;
+
+    while (step_count != 0)
+    {
+        if (step_count & 1)
+        {
+            jump_mult = jump_mult * step_mult;
+            jump_add = jump_add * step_mult + step_add;
+        }
+
+        // Compose the 2^i steps map with itself
+        step_add = step_add * step_mult + step_add;
+        step_mult = step_mult * step_mult;
+        step_count >>= 1;
+    }
+
+    *mult_ptr = jump_mult;
+    *add_ptr = jump_add;
+}
+
+/**
+ * Advance a PCG64 state by step_count steps, in O(log step_count) (same as private_getJumpMap(), on 128 bits)
+ * 
+ * @param state_ptr
+ * @param step_count
+ */
+static void private_jumpPcg(simpleRNG_state_t *state_ptr, unsigned __int128 step_count)
+{
+    unsigned __int128 jump_mult = 1;
+    unsigned __int128 jump_add = 0;
+    unsigned __int128 step_mult = PCG_MULT_CONSTANT;
+    unsigned __int128 step_add = state_ptr->pcg.increment;
+
+    while (step_count != 0)
+    {
+        if (step_count & 1)
+        {
+            jump_mult = jump_mult * step_mult;
+            jump_add = jump_add * step_mult + step_add;
+        }
+
+        step_add = step_add * step_mult + step_add;
+        step_mult = step_mult * step_mult;
+        step_count >>= 1;
+    }
+
+    state_ptr->pcg.state = state_ptr->pcg.state * jump_mult + jump_add;
+}
+
+/**
+ * Get the number of steps from one LCG state (mod 2^128) to another, one bit at a time :
+ * bit i of the distance is set if the states still differ on bit i after the lower bits were matched.
+ * Needs a full period LCG (odd increment, multiplier = 1 mod 4).
+ * 
+ * @param from
+ * @param to
+ * @param step_mult
+ * @param step_add
+ * @param state_mask bits of the LCG state (the low bits of an LCG mod 2^128 are an LCG mod 2^64)
+ */
+static unsigned __int128 private_getLcgDistance(unsigned __int128 from, unsigned __int128 to, unsigned __int128 step_mult, unsigned __int128 step_add, unsigned __int128 state_mask)
+{
+    unsigned __int128 distance = 0;
+    unsigned __int128 bit = 1;
+
+    while ((from ^ to) & state_mask)
+    {
+        if ((from ^ to) & bit)
+        {
+            from = from * step_mult + step_add;
+            distance |= bit;
+        }
+
+        // Map of 2^(i+1) steps
+        step_add = step_add * step_mult + step_add;
+        step_mult = step_mult * step_mult;
+        bit <<= 1;
+    }
+
+    return distance;
+}
+
+/**
+ * Advance a xoshiro256** state by 2^128 steps (jump polynomial from https://prng.di.unimi.it)
+ * 
+ * @param state_ptr
+ */
+static void private_jumpXoshiro(simpleRNG_state_t *state_ptr)
+{
+    static const uint64_t jump_polynomial[4] = {0x180EC6D33CFD0ABAUL, 0xD5A61266F0C9392CUL, 0xA9582618E03FC9AAUL, 0x39ABDC4529B1661CUL};
+    uint64_t jumped[4] = {0};
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        for (uint32_t bit = 0; bit < 64; bit++)
+        {
+            if (jump_polynomial[i] & (1UL << bit))
+            {
+                for (uint32_t j = 0; j < 4; j++)
+                {
+                    jumped[j] ^= state_ptr->xoshiro[j];
+                }
+            }
+            private_getNextXoshiro(state_ptr);
+        }
+    }
+
+    memcpy(state_ptr->xoshiro, jumped, sizeof jumped);
+}
+
+/**
+ * Fill a buffer with offsets in [0, range - 1] from interleaved LCG lanes, without SIMD.
+ * Lane i generates numbers i, i + FILL_LANE_COUNT, i + 2 * FILL_LANE_COUNT... of the sequence, so the
+ * multiplications of different lanes do not depend on each other and can run in parallel in the CPU.
+ * Rejected numbers are marked with FILL_REJECTED.
+ * 
+ * @param lanes next number of every lane, updated
+ * @param lane_mult multiplier of FILL_LANE_COUNT steps
+ * @param lane_add increment of FILL_LANE_COUNT steps
+ * @param out
+ * @param count multiple of FILL_LANE_COUNT
+ * @param range
+ * @param threshold 2^32 % range, products whose low half is under it are rejected
+ */
+static void private_fillLanes(uint64_t lanes[FILL_LANE_COUNT], uint64_t lane_mult, uint64_t lane_add, uint32_t *out, uint32_t count, uint32_t range, uint32_t threshold)
+{
+    for (uint32_t i = 0; i < count; i += FILL_LANE_COUNT)
+    {
+        for (uint32_t lane = 0; lane < FILL_LANE_COUNT; lane++)
+        {
+            uint64_t product = (lanes[lane] >> 32) * range;
+            out[i + lane] = ((uint32_t) product < threshold) ? FILL_REJECTED : (uint32_t) (product >> 32);
+            lanes[lane] = lanes[lane] * lane_mult + lane_add;
+        }
+    }
+}
+
+#ifdef SIMPLERNG_HAS_AVX2_FILL
+/**
+ * Same as private_fillLanes(), with the FILL_LANE_COUNT lanes in one AVX2 vector.
+ * AVX2 has no 64 bit multiplication, so it is made of three 32 x 32 -> 64 bit multiplications.
+ */
+__attribute__((target("avx2")))
+static void private_fillLanesAvx2(uint64_t lanes[FILL_LANE_COUNT], uint64_t lane_mult, uint64_t lane_add, uint32_t *out, uint32_t count, uint32_t range, uint32_t threshold)
+{
+    __m256i state = _mm256_loadu_si256((const __m256i *) lanes);
+    const __m256i mult = _mm256_set1_epi64x((int64_t) lane_mult);
+    const __m256i mult_high = _mm256_set1_epi64x((int64_t) (lane_mult >> 32));
+    const __m256i add = _mm256_set1_epi64x((int64_t) lane_add);
+    const __m256i range_vector = _mm256_set1_epi64x(range);
+    const __m256i threshold_vector = _mm256_set1_epi64x(threshold);
+    const __m256i low_mask = _mm256_set1_epi64x(0xFFFFFFFFL);
+    const __m256i rejected = _mm256_set1_epi64x(FILL_REJECTED);
+    const __m256i pack_indices = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    for (uint32_t i = 0; i < count; i += FILL_LANE_COUNT)
+    {
+        // Lemire's multiply-shift on the high 32 bits of every lane
+        __m256i product = _mm256_mul_epu32(_mm256_srli_epi64(state, 32), range_vector);
+        __m256i offset = _mm256_srli_epi64(product, 32);
+        __m256i is_rejected = _mm256_cmpgt_epi64(threshold_vector, _mm256_and_si256(product, low_mask));
+        offset = _mm256_blendv_epi8(offset, rejected, is_rejected);
+
+        // Keep the low 32 bits of every 64 bit lane
+        _mm_storeu_si128((__m128i *) &out[i], _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(offset, pack_indices)));
+
+        // state = state * mult + add, with low * low + ((high * low + low * high) << 32)
+        __m256i low_low = _mm256_mul_epu32(state, mult);
+        __m256i high_low = _mm256_mul_epu32(_mm256_srli_epi64(state, 32), mult);
+        __m256i low_high = _mm256_mul_epu32(state, mult_high);
+        __m256i cross = _mm256_slli_epi64(_mm256_add_epi64(high_low, low_high), 32);
+        state = _mm256_add_epi64(_mm256_add_epi64(low_low, cross), add);
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes, state);
+}
+#endif
+
+/**
+ * Draw a binomial number by inversion : walk the cumulative distribution until it passes a uniform number.
+ * Takes O(mean) steps, so only used for small means. Port of numpy's random_binomial_inversion().
+ * 
+ * @param state_ptr
+ * @param trial_count
+ * @param probability at most 0.5
+ */
+static uint64_t private_getBinomialInversion(simpleRNG_state_t *state_ptr, uint64_t trial_count, double probability)
 {
-    current_number = current_number * RNG_MULT_CONSTANT + RNG_ADD_CONSTANT;
-    return current_number;
+    double q = 1.0 - probability;
+    double q_n = exp(trial_count * log(q));
+    double mean = trial_count * probability;
+    double bound_value = mean + 10.0 * sqrt(mean * q + 1);
+    uint64_t bound = (bound_value < (double) trial_count) ? (uint64_t) bound_value : trial_count;
+
+    uint64_t x = 0;
+    double p_x = q_n;
+    double u = simpleRNG_randomDouble_r(state_ptr);
+
+    while (u > p_x)
+    {
+        x++;
+        if (x > bound)
+        {
+            // Restart if rounding errors made the walk go too far
+            x = 0;
+            p_x = q_n;
+            u = simpleRNG_randomDouble_r(state_ptr);
+        }
+        else
+        {
+            u -= p_x;
+            p_x = ((trial_count - x + 1) * probability * p_x) / (x * q);
+        }
+    }
+
+    return x;
+}
+
+/**
+ * Draw a binomial number with the BTPE algorithm (Kachitvichyanukul & Schmeiser, 1988) : exact rejection sampling
+ * from a triangle/parallelogram/exponential hat, in O(1) expected time. Port of numpy's random_binomial_btpe().
+ * 
+ * @param state_ptr
+ * @param trial_count
+ * @param probability at most 0.5, with trial_count * probability above BINOMIAL_INVERSION_MAX_MEAN
+ */
+static uint64_t private_getBinomialBtpe(simpleRNG_state_t *state_ptr, uint64_t trial_count, double probability)
+{
+    double n = (double) trial_count;
+    double r = probability;
+    double q = 1.0 - r;
+    double fm = n * r + r;
+    int64_t m = (int64_t) floor(fm);
+    double p1 = floor(2.195 * sqrt(n * r * q) - 4.6 * q) + 0.5;
+    double xm = m + 0.5;
+    double xl = xm - p1;
+    double xr = xm + p1;
+    double c = 0.134 + 20.5 / (15.3 + m);
+    double a = (fm - xl) / (fm - xl * r);
+    double laml = a * (1.0 + a / 2.0);
+    a = (xr - fm) / (xr * q);
+    double lamr = a * (1.0 + a / 2.0);
+    double p2 = p1 * (1.0 + 2.0 * c);
+    double p3 = p2 + c / laml;
+    double p4 = p3 + c / lamr;
+    double nrq = n * r * q;
+
+    double u, v, x;
+    int64_t y, k;
+
+step10:
+    u = simpleRNG_randomDouble_r(state_ptr) * p4;
+    v = simpleRNG_randomDouble_r(state_ptr);
+    if (u <= p1)
+    {
+        // Triangle
+        y = (int64_t) floor(xm - p1 * v + u);
+        goto step60;
+    }
+
+    if (u <= p2)
+    {
+        // Parallelograms
+        x = xl + (u - p1) / c;
+        v = v * c + 1.0 - fabs(m - x + 0.5) / p1;
+        if (v > 1.0)
+        {
+            goto step10;
+        }
+        y = (int64_t) floor(x);
+    }
+    else if (u <= p3)
+    {
+        // Left exponential tail
+        y = (int64_t) floor(xl + log(v) / laml);
+        if ((y < 0) || (v == 0.0))
+        {
+            goto step10;
+        }
+        v = v * (u - p2) * laml;
+    }
+    else
+    {
+        // Right exponential tail
+        y = (int64_t) floor(xr - log(v) / lamr);
+        if ((y > (int64_t) trial_count) || (v == 0.0))
+        {
+            goto step10;
+        }
+        v = v * (u - p3) * lamr;
+    }
+
+    k = (y > m) ? (y - m) : (m - y);
+    if ((k <= 20) || (k >= nrq / 2.0 - 1))
+    {
+        // Explicit evaluation of f(y) / f(m)
+        double s = r / q;
+        double a_s = s * (n + 1);
+        double f = 1.0;
+
+        if (m < y)
+        {
+            for (int64_t i = m + 1; i <= y; i++)
+            {
+                f *= (a_s / i - s);
+            }
+        }
+        else if (m > y)
+        {
+            for (int64_t i = y + 1; i <= m; i++)
+            {
+                f /= (a_s / i - s);
+            }
+        }
+
+        if (v > f)
+        {
+            goto step10;
+        }
+        goto step60;
+    }
+
+    // Squeeze using upper and lower bounds on log(f(y))
+    double rho = (k / nrq) * ((k * (k / 3.0 + 0.625) + 0.16666666666666666) / nrq + 0.5);
+    double t = -k * k / (2 * nrq);
+    double log_v = log(v);
+    if (log_v < (t - rho))
+    {
+        goto step60;
+    }
+    if (log_v > (t + rho))
+    {
+        goto step10;
+    }
+
+    // Final acceptance with Stirling's formula
+    double x1 = y + 1;
+    double f1 = m + 1;
+    double z = n + 1 - m;
+    double w = n - y + 1;
+    double x2 = x1 * x1;
+    double f2 = f1 * f1;
+    double z2 = z * z;
+    double w2 = w * w;
+
+    if (log_v > (xm * log(f1 / x1) + (n - m + 0.5) * log(z / w) + (y - m) * log(w * r / (x1 * q))
+        + (13680. - (462. - (132. - (99. - 140. / f2) / f2) / f2) / f2) / f1 / 166320.
+        + (13680. - (462. - (132. - (99. - 140. / z2) / z2) / z2) / z2) / z / 166320.
+        + (13680. - (462. - (132. - (99. - 140. / x2) / x2) / x2) / x2) / x1 / 166320.
+        + (13680. - (462. - (132. - (99. - 140. / w2) / w2) / w2) / w2) / w / 166320.))
+    {
+        goto step10;
+    }
+
+step60:
+    return (uint64_t) y;
 }
 
 /************************************************************************************************************
- * Public functions
+ * Public functions (explicit state)
  */
 
  /**
-  * Initialize the RNG.
+  * Initialize an RNG state with the default backend (SIMPLERNG_DEFAULT_BACKEND).
   * 
+  * @param state_ptr
   * @param seed seed used for generating numbers
   */
-void simpleRNG_init(uint64_t seed)
+void simpleRNG_init_r(simpleRNG_state_t *state_ptr, uint64_t seed)
+{
+    simpleRNG_initBackend_r(state_ptr, SIMPLERNG_DEFAULT_BACKEND, seed);
+}
+
+/**
+ * Initialize an RNG state with the given backend.
+ * 
+ * @param state_ptr
+ * @param backend generator used by the state
+ * @param seed seed used for generating numbers
+ */
+void simpleRNG_initBackend_r(simpleRNG_state_t *state_ptr, simpleRNG_backend_t backend, uint64_t seed)
 {
-    current_number = seed;
+    memset(state_ptr, 0, sizeof *state_ptr);
+    state_ptr->backend = backend;
+
+    switch (backend)
+    {
+    case SIMPLERNG_BACKEND_XOSHIRO256SS:
+        // The state must not be all zeros, which SplitMix64 outputs never are
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            state_ptr->xoshiro[i] = private_splitMix64(&seed);
+        }
+        break;
+
+    case SIMPLERNG_BACKEND_PCG64:
+        // Seeding procedure of the PCG reference implementation
+        state_ptr->pcg.increment = PCG_DEFAULT_INCREMENT;
+        private_getNextPcg(state_ptr);
+        state_ptr->pcg.state += ((unsigned __int128) private_splitMix64(&seed) << 64) | private_splitMix64(&seed);
+        private_getNextPcg(state_ptr);
+        break;
+
+    default:
+        state_ptr->backend = SIMPLERNG_BACKEND_LCG;
+        state_ptr->current_number = seed;
+        break;
+    }
+}
+
+/**
+ * Get the backend that has the given name ("lcg", "xoshiro256**" or "pcg64").
+ * Returns false if no backend has this name.
+ * 
+ * @param name
+ * @param backend_ptr
+ */
+bool simpleRNG_getBackendFromName(const char *name, simpleRNG_backend_t *backend_ptr)
+{
+    static const char *backend_names[SIMPLERNG_BACKEND_COUNT] = {"lcg", "xoshiro256**", "pcg64"};
+
+    for (uint32_t i = 0; i < SIMPLERNG_BACKEND_COUNT; i++)
+    {
+        if (strcmp(name, backend_names[i]) == 0)
+        {
+            *backend_ptr = (simpleRNG_backend_t) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Advance an RNG state as if step_count numbers had been generated, in O(log step_count).
+ * Returns false if the backend does not support it (xoshiro256** can only jump to its next stream).
+ * 
+ * @param state_ptr
+ * @param step_count number of generated numbers to skip
+ */
+bool simpleRNG_jump_r(simpleRNG_state_t *state_ptr, uint64_t step_count)
+{
+    uint64_t jump_mult;
+    uint64_t jump_add;
+
+    switch (state_ptr->backend)
+    {
+    case SIMPLERNG_BACKEND_XOSHIRO256SS:
+        return false;
+        break;
+
+    case SIMPLERNG_BACKEND_PCG64:
+        private_jumpPcg(state_ptr, step_count);
+        break;
+
+    default:
+        private_getJumpMap(step_count, &jump_mult, &jump_add);
+        state_ptr->current_number = state_ptr->current_number * jump_mult + jump_add;
+        break;
+    }
+
+    return true;
+}
+
+/**
+ * Advance an RNG state to the start of its next stream.
+ * Streams of one seed never overlap : they are 2^48 numbers long for the LCG, 2^64 for PCG64 and 2^128 for xoshiro256**.
+ * Meant to give independent generators to parallel workers.
+ * 
+ * @param state_ptr
+ */
+void simpleRNG_jumpStream_r(simpleRNG_state_t *state_ptr)
+{
+    switch (state_ptr->backend)
+    {
+    case SIMPLERNG_BACKEND_XOSHIRO256SS:
+        private_jumpXoshiro(state_ptr);
+        break;
+
+    case SIMPLERNG_BACKEND_PCG64:
+        private_jumpPcg(state_ptr, (unsigned __int128) 1 << 64);
+        break;
+
+    default:
+        simpleRNG_jump_r(state_ptr, LCG_STREAM_LENGTH);
+        break;
+    }
+}
+
+/**
+ * Get the number of non-overlapping streams of a seed (see simpleRNG_jumpStream_r()), saturated to UINT64_MAX.
+ * Jumping more times than this comes back to the first stream.
+ * 
+ * @param state_ptr
+ */
+uint64_t simpleRNG_getStreamCount_r(const simpleRNG_state_t *state_ptr)
+{
+    switch (state_ptr->backend)
+    {
+    case SIMPLERNG_BACKEND_XOSHIRO256SS:
+    case SIMPLERNG_BACKEND_PCG64:
+        return UINT64_MAX;
+        break;
+
+    default:
+        return UINT64_MAX / LCG_STREAM_LENGTH + 1;
+        break;
+    }
+}
+
+/**
+ * Get the number of random numbers drawn to go from one state to another, in O(log distance).
+ * Returns false for xoshiro256** (not supported), or if the states use different backends or PCG64 streams.
+ * 
+ * @param from_ptr
+ * @param to_ptr state reached from from_ptr
+ * @param distance_ptr set to the number of numbers drawn (mod 2^64)
+ */
+bool simpleRNG_getDistance_r(const simpleRNG_state_t *from_ptr, const simpleRNG_state_t *to_ptr, uint64_t *distance_ptr)
+{
+    if (from_ptr->backend != to_ptr->backend)
+    {
+        return false;
+    }
+
+    switch (from_ptr->backend)
+    {
+    case SIMPLERNG_BACKEND_XOSHIRO256SS:
+        return false;
+        break;
+
+    case SIMPLERNG_BACKEND_PCG64:
+        if (from_ptr->pcg.increment != to_ptr->pcg.increment)
+        {
+            return false;
+        }
+        *distance_ptr = (uint64_t) private_getLcgDistance(from_ptr->pcg.state, to_ptr->pcg.state, PCG_MULT_CONSTANT, from_ptr->pcg.increment, ~(unsigned __int128) 0);
+        break;
+
+    default:
+        *distance_ptr = (uint64_t) private_getLcgDistance(from_ptr->current_number, to_ptr->current_number, RNG_MULT_CONSTANT, RNG_ADD_CONSTANT, UINT64_MAX);
+        break;
+    }
+
+    return true;
 }
 
 /**
  * Get a random 64 bit unsigned int
+ * 
+ * @param state_ptr
  */
-uint64_t simpleRNG_randomUint64()
+uint64_t simpleRNG_randomUint64_r(simpleRNG_state_t *state_ptr)
 {
-    return private_getNextNumber();
+    return private_getNextNumber(state_ptr);
 }
 
 /**
  * Get a random 32 bit unsigned int
+ * 
+ * @param state_ptr
  */
-uint32_t simpleRNG_randomUint32()
+uint32_t simpleRNG_randomUint32_r(simpleRNG_state_t *state_ptr)
 {
-    return (uint32_t) (private_getNextNumber() >> 32);
+    return (uint32_t) (private_getNextNumber(state_ptr) >> 32);
 }
 
 /**
  * Get a random 8 bit unsigned int
+ * 
+ * @param state_ptr
  */
-uint8_t simpleRNG_randomUint8()
+uint8_t simpleRNG_randomUint8_r(simpleRNG_state_t *state_ptr)
 {
-    return (uint8_t) (private_getNextNumber() >> 56);
+    return (uint8_t) (private_getNextNumber(state_ptr) >> 56);
 }
 
 /**
  * Get a random 64 bit signed int
+ * 
+ * @param state_ptr
  */
-int64_t simpleRNG_randomInt64()
+int64_t simpleRNG_randomInt64_r(simpleRNG_state_t *state_ptr)
 {
-    return (int64_t) (private_getNextNumber());
+    return (int64_t) (private_getNextNumber(state_ptr));
 }
 
 /**
  * Get a random 32 bit signed int
+ * 
+ * @param state_ptr
  */
-int32_t simpleRNG_randomInt32()
+int32_t simpleRNG_randomInt32_r(simpleRNG_state_t *state_ptr)
 {
     // The & operation is there to make sure the number fits and avoids any implementation-specific behavior (C17 standard).
-    return (int32_t) ((private_getNextNumber() >> 32) & 0xFFFFFFFFUL);
+    return (int32_t) ((private_getNextNumber(state_ptr) >> 32) & 0xFFFFFFFFUL);
 }
 
 /**
  * Get a random 8 bit signed int
+ * 
+ * @param state_ptr
  */
-int8_t simpleRNG_randomInt8()
+int8_t simpleRNG_randomInt8_r(simpleRNG_state_t *state_ptr)
 {
     // The & operation is there to make sure the number fits and avoids any implementation-specific behavior (C17 standard).
-    return (int8_t) ((private_getNextNumber() >> 56) & 0xFFUL);
+    return (int8_t) ((private_getNextNumber(state_ptr) >> 56) & 0xFFUL);
 }
 
 /**
  * Get a 64 bit unsigned int that is within given bounds
  * 
+ * @param state_ptr
  * @param min_value Minimum possible return value 
  * @param max_value Maximum possible return value
  */
-uint64_t simpleRNG_randomUint64InRange(uint64_t min_value, uint64_t max_value)
+uint64_t simpleRNG_randomUint64InRange_r(simpleRNG_state_t *state_ptr, uint64_t min_value, uint64_t max_value)
 {
-    if (max_value <= min_value)
+    if (max_value < min_value)
     {
         return 0;
     }
 
-    // Adds 1 to the % operation in order to make the max_value a possible result
-    return (min_value + private_getNextNumber() % (max_value - min_value + 1));
+    // Adds 1 to make the max_value a possible result. Computed unsigned so that the full range wraps to 0.
+    return (uint64_t) (min_value + private_getBoundedUint64(state_ptr, (uint64_t) max_value - (uint64_t) min_value + 1));
 }
 
 /**
  * Get a 32 bit unsigned int that is within given bounds
  * 
+ * @param state_ptr
  * @param min_value Minimum possible return value 
  * @param max_value Maximum possible return value
  */
-uint32_t simpleRNG_randomUint32InRange(uint32_t min_value, uint32_t max_value)
+uint32_t simpleRNG_randomUint32InRange_r(simpleRNG_state_t *state_ptr, uint32_t min_value, uint32_t max_value)
 {
-    if (max_value <= min_value)
+    if (max_value < min_value)
     {
         return 0;
     }
 
-    // Adds 1 to the % operation in order to make the max_value a possible result
-    return (min_value + simpleRNG_randomUint32() % (max_value - min_value + 1));
+    // Adds 1 to make the max_value a possible result. Computed unsigned so that the full range wraps to 0.
+    return (uint32_t) (min_value + private_getBoundedUint32(state_ptr, (uint32_t) max_value - (uint32_t) min_value + 1));
 }
 
 /**
  * Get a 8 bit unsigned int that is within given bounds
  * 
+ * @param state_ptr
  * @param min_value Minimum possible return value 
  * @param max_value Maximum possible return value
  */
-uint8_t simpleRNG_randomUint8InRange(uint8_t min_value, uint8_t max_value)
+uint8_t simpleRNG_randomUint8InRange_r(simpleRNG_state_t *state_ptr, uint8_t min_value, uint8_t max_value)
 {
-    if (max_value <= min_value)
+    if (max_value < min_value)
     {
         return 0;
     }
 
-    // Adds 1 to the % operation in order to make the max_value a possible result
-    return (min_value + simpleRNG_randomUint8() % (max_value - min_value + 1));
+    // Adds 1 to make the max_value a possible result. Computed unsigned so that the full range wraps to 0.
+    return (uint8_t) (min_value + private_getBoundedUint32(state_ptr, (uint32_t) max_value - (uint32_t) min_value + 1));
 }
 
 /**
  * Get a 64 bit signed int that is within given bounds
  * 
+ * @param state_ptr
  * @param min_value Minimum possible return value 
  * @param max_value Maximum possible return value
  */
-int64_t simpleRNG_randomInt64InRange(int64_t min_value, int64_t max_value)
+int64_t simpleRNG_randomInt64InRange_r(simpleRNG_state_t *state_ptr, int64_t min_value, int64_t max_value)
 {
-    if (max_value <= min_value)
+    if (max_value < min_value)
     {
         return 0;
     }
 
-    // Adds 1 to the % operation in order to make the max_value a possible result
-    return (min_value + simpleRNG_randomInt64() % (max_value - min_value + 1));
+    // Adds 1 to make the max_value a possible result. Computed unsigned so that the full range wraps to 0.
+    return (int64_t) (min_value + private_getBoundedUint64(state_ptr, (uint64_t) max_value - (uint64_t) min_value + 1));
 }
 
 /**
  * Get a 32 bit signed int that is within given bounds
  * 
+ * @param state_ptr
  * @param min_value Minimum possible return value 
  * @param max_value Maximum possible return value
  */
-int32_t simpleRNG_randomInt32InRange(int32_t min_value, int32_t max_value)
+int32_t simpleRNG_randomInt32InRange_r(simpleRNG_state_t *state_ptr, int32_t min_value, int32_t max_value)
 {
-    if (max_value <= min_value)
+    if (max_value < min_value)
     {
         return 0;
     }
 
-    // Adds 1 to the % operation in order to make the max_value a possible result
-    return (min_value + simpleRNG_randomInt32() % (max_value - min_value + 1));
+    // Adds 1 to make the max_value a possible result. Computed unsigned so that the full range wraps to 0.
+    return (int32_t) (min_value + private_getBoundedUint32(state_ptr, (uint32_t) max_value - (uint32_t) min_value + 1));
 }
 
 /**
  * Get a 8 bit signed int that is within given bounds
  * 
+ * @param state_ptr
  * @param min_value Minimum possible return value 
  * @param max_value Maximum possible return value
  */
-int8_t simpleRNG_randomInt8InRange(int8_t min_value, int8_t max_value)
+int8_t simpleRNG_randomInt8InRange_r(simpleRNG_state_t *state_ptr, int8_t min_value, int8_t max_value)
 {
-    if (max_value <= min_value)
+    if (max_value < min_value)
     {
         return 0;
     }
 
-    // Adds 1 to the % operation in order to make the max_value a possible result
-    return (min_value + simpleRNG_randomInt8() % (max_value - min_value + 1));
+    // Adds 1 to make the max_value a possible result. Computed unsigned so that the full range wraps to 0.
+    return (int8_t) (min_value + private_getBoundedUint32(state_ptr, (uint32_t) max_value - (uint32_t) min_value + 1));
+}
+
+/**
+ * Get a random float between 0 and 1
+ * 
+ * @param state_ptr
+ */
+float simpleRNG_randomFloat_r(simpleRNG_state_t *state_ptr)
+{
+    return ((float) simpleRNG_randomUint32_r(state_ptr) / (float) 0xFFFFFFFFU);
+}
+
+/**
+ * Get a random double between 0 and 1
+ * 
+ * @param state_ptr
+ */
+double simpleRNG_randomDouble_r(simpleRNG_state_t *state_ptr)
+{
+    return ((double) simpleRNG_randomUint64_r(state_ptr) / (double) 0xFFFFFFFFFFFFFFFFUL);
+}
+
+/**
+ * Get the number of successes out of trial_count independent trials that each succeed with the given probability.
+ * Exact in distribution, in O(1) expected time for large trial counts.
+ * 
+ * @param state_ptr
+ * @param trial_count
+ * @param probability probability of success of each trial, between 0 and 1
+ */
+uint64_t simpleRNG_randomBinomial_r(simpleRNG_state_t *state_ptr, uint64_t trial_count, double probability)
+{
+    if ((trial_count == 0) || (probability <= 0.0))
+    {
+        return 0;
+    }
+    if (probability >= 1.0)
+    {
+        return trial_count;
+    }
+
+    // Both algorithms need probability <= 0.5 : count failures instead of successes otherwise
+    bool is_flipped = (probability > 0.5);
+    double p = is_flipped ? (1.0 - probability) : probability;
+    uint64_t successes = (trial_count * p <= BINOMIAL_INVERSION_MAX_MEAN) ? private_getBinomialInversion(state_ptr, trial_count, p) : private_getBinomialBtpe(state_ptr, trial_count, p);
+
+    return is_flipped ? (trial_count - successes) : successes;
+}
+
+/**
+ * Fill a buffer with 32 bit unsigned ints that are within given bounds, much faster than calling
+ * simpleRNG_randomUint32InRange_r() count times : several LCG lanes are interleaved to generate numbers in parallel,
+ * in AVX2 vectors when the CPU supports it. Other backends than the LCG generate one number at a time.
+ * Every number is uniform and independent, but they are not in the order simpleRNG_randomUint32InRange_r() would give.
+ * 
+ * @param state_ptr
+ * @param out buffer of at least count numbers
+ * @param count
+ * @param min_value Minimum possible value 
+ * @param max_value Maximum possible value
+ */
+void simpleRNG_fillUint32InRange_r(simpleRNG_state_t *state_ptr, uint32_t *out, uint32_t count, uint32_t min_value, uint32_t max_value)
+{
+    uint32_t range = max_value - min_value + 1;
+    uint32_t lane_count = count - (count % FILL_LANE_COUNT);
+
+    // The full 32 bit range wraps to 0
+    if ((max_value < min_value) || (range == 0) || (range > FILL_MAX_RANGE) || (lane_count == 0) || (state_ptr->backend != SIMPLERNG_BACKEND_LCG))
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            out[i] = simpleRNG_randomUint32InRange_r(state_ptr, min_value, max_value);
+        }
+        return;
+    }
+
+    uint32_t threshold = (0U - range) % range; // 2^32 % range
+    uint64_t lanes[FILL_LANE_COUNT];
+    uint64_t lane_mult;
+    uint64_t lane_add;
+    uint64_t first_number = state_ptr->current_number;
+
+    private_getJumpMap(FILL_LANE_COUNT, &lane_mult, &lane_add);
+
+    for (uint32_t lane = 0; lane < FILL_LANE_COUNT; lane++)
+    {
+        lanes[lane] = private_getNextNumber(state_ptr);
+    }
+
+#ifdef SIMPLERNG_HAS_AVX2_FILL
+    if (__builtin_cpu_supports("avx2"))
+    {
+        private_fillLanesAvx2(lanes, lane_mult, lane_add, out, lane_count, range, threshold);
+    }
+    else
+#endif
+    {
+        private_fillLanes(lanes, lane_mult, lane_add, out, lane_count, range, threshold);
+    }
+
+    // Continue the sequence right after the numbers used by the lanes
+    state_ptr->current_number = first_number;
+    simpleRNG_jump_r(state_ptr, lane_count);
+
+    for (uint32_t i = lane_count; i < count; i++)
+    {
+        out[i] = private_getBoundedUint32(state_ptr, range);
+    }
+
+    for (uint32_t i = 0; i < lane_count; i++)
+    {
+        if (out[i] == FILL_REJECTED)
+        {
+            out[i] = private_getBoundedUint32(state_ptr, range);
+        }
+        out[i] += min_value;
+    }
+
+    for (uint32_t i = lane_count; i < count; i++)
+    {
+        out[i] += min_value;
+    }
+}
+
+/************************************************************************************************************
+ * Public functions (state of the calling thread)
+ */
+
+/**
+ * Get the RNG state of the calling thread, used by every function without _r suffix
+ */
+simpleRNG_state_t *simpleRNG_getState()
+{
+    return &default_state;
+}
+
+ /**
+  * Initialize the RNG of the calling thread.
+  * 
+  * @param seed seed used for generating numbers
+  */
+void simpleRNG_init(uint64_t seed)
+{
+    simpleRNG_init_r(&default_state, seed);
+}
+
+/**
+ * Initialize the RNG of the calling thread with the given backend.
+ * 
+ * @param backend generator used by the thread
+ * @param seed seed used for generating numbers
+ */
+void simpleRNG_initBackend(simpleRNG_backend_t backend, uint64_t seed)
+{
+    simpleRNG_initBackend_r(&default_state, backend, seed);
+}
+
+/**
+ * Advance the RNG of the calling thread as if step_count numbers had been generated, in O(log step_count).
+ * Returns false if the backend does not support it.
+ * 
+ * @param step_count number of generated numbers to skip
+ */
+bool simpleRNG_jump(uint64_t step_count)
+{
+    return simpleRNG_jump_r(&default_state, step_count);
+}
+
+/**
+ * Advance the RNG of the calling thread to the start of its next stream.
+ */
+void simpleRNG_jumpStream()
+{
+    simpleRNG_jumpStream_r(&default_state);
+}
+
+/**
+ * Get a random 64 bit unsigned int
+ */
+uint64_t simpleRNG_randomUint64()
+{
+    return simpleRNG_randomUint64_r(&default_state);
+}
+
+/**
+ * Get a random 32 bit unsigned int
+ */
+uint32_t simpleRNG_randomUint32()
+{
+    return simpleRNG_randomUint32_r(&default_state);
+}
+
+/**
+ * Get a random 8 bit unsigned int
+ */
+uint8_t simpleRNG_randomUint8()
+{
+    return simpleRNG_randomUint8_r(&default_state);
+}
+
+/**
+ * Get a random 64 bit signed int
+ */
+int64_t simpleRNG_randomInt64()
+{
+    return simpleRNG_randomInt64_r(&default_state);
+}
+
+/**
+ * Get a random 32 bit signed int
+ */
+int32_t simpleRNG_randomInt32()
+{
+    return simpleRNG_randomInt32_r(&default_state);
+}
+
+/**
+ * Get a random 8 bit signed int
+ */
+int8_t simpleRNG_randomInt8()
+{
+    return simpleRNG_randomInt8_r(&default_state);
+}
+
+/**
+ * Get a 64 bit unsigned int that is within given bounds
+ * 
+ * @param min_value Minimum possible return value 
+ * @param max_value Maximum possible return value
+ */
+uint64_t simpleRNG_randomUint64InRange(uint64_t min_value, uint64_t max_value)
+{
+    return simpleRNG_randomUint64InRange_r(&default_state, min_value, max_value);
+}
+
+/**
+ * Get a 32 bit unsigned int that is within given bounds
+ * 
+ * @param min_value Minimum possible return value 
+ * @param max_value Maximum possible return value
+ */
+uint32_t simpleRNG_randomUint32InRange(uint32_t min_value, uint32_t max_value)
+{
+    return simpleRNG_randomUint32InRange_r(&default_state, min_value, max_value);
+}
+
+/**
+ * Get a 8 bit unsigned int that is within given bounds
+ * 
+ * @param min_value Minimum possible return value 
+ * @param max_value Maximum possible return value
+ */
+uint8_t simpleRNG_randomUint8InRange(uint8_t min_value, uint8_t max_value)
+{
+    return simpleRNG_randomUint8InRange_r(&default_state, min_value, max_value);
+}
+
+/**
+ * Get a 64 bit signed int that is within given bounds
+ * 
+ * @param min_value Minimum possible return value 
+ * @param max_value Maximum possible return value
+ */
+int64_t simpleRNG_randomInt64InRange(int64_t min_value, int64_t max_value)
+{
+    return simpleRNG_randomInt64InRange_r(&default_state, min_value, max_value);
+}
+
+/**
+ * Get a 32 bit signed int that is within given bounds
+ * 
+ * @param min_value Minimum possible return value 
+ * @param max_value Maximum possible return value
+ */
+int32_t simpleRNG_randomInt32InRange(int32_t min_value, int32_t max_value)
+{
+    return simpleRNG_randomInt32InRange_r(&default_state, min_value, max_value);
+}
+
+/**
+ * Get a 8 bit signed int that is within given bounds
+ * 
+ * @param min_value Minimum possible return value 
+ * @param max_value Maximum possible return value
+ */
+int8_t simpleRNG_randomInt8InRange(int8_t min_value, int8_t max_value)
+{
+    return simpleRNG_randomInt8InRange_r(&default_state, min_value, max_value);
 }
 
 /**
@@ -194,7 +1194,7 @@ int8_t simpleRNG_randomInt8InRange(int8_t min_value, int8_t max_value)
  */
 float simpleRNG_randomFloat()
 {
-    return ((float) simpleRNG_randomUint32() / (float) 0xFFFFFFFFU);
+    return simpleRNG_randomFloat_r(&default_state);
 }
 
 /**
@@ -202,5 +1202,29 @@ float simpleRNG_randomFloat()
  */
 double simpleRNG_randomDouble()
 {
-    return ((double) simpleRNG_randomUint64() / (double) 0xFFFFFFFFFFFFFFFFUL);
+    return simpleRNG_randomDouble_r(&default_state);
+}
+
+/**
+ * Fill a buffer with 32 bit unsigned ints that are within given bounds
+ * 
+ * @param out buffer of at least count numbers
+ * @param count
+ * @param min_value Minimum possible value 
+ * @param max_value Maximum possible value
+ */
+void simpleRNG_fillUint32InRange(uint32_t *out, uint32_t count, uint32_t min_value, uint32_t max_value)
+{
+    simpleRNG_fillUint32InRange_r(&default_state, out, count, min_value, max_value);
+}
+
+/**
+ * Get the number of successes out of trial_count independent trials that each succeed with the given probability
+ * 
+ * @param trial_count
+ * @param probability probability of success of each trial, between 0 and 1
+ */
+uint64_t simpleRNG_randomBinomial(uint64_t trial_count, double probability)
+{
+    return simpleRNG_randomBinomial_r(&default_state, trial_count, probability);
 }
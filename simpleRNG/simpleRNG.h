@@ -2,10 +2,15 @@
  * @file simpleRandom.h
  * @author Kezia Marcou
  * @brief Simple implementation of a pseudo-random number generator.
- * Uses a linear congruential generator (mod 2^64)
+ * Uses a linear congruential generator (mod 2^64) by default. xoshiro256** and PCG64 backends are also available :
+ * slightly slower, but with much better statistical quality (especially in the low bits).
+ * Functions with the _r suffix use the given state, and can be used from any thread with independent states.
+ * Functions without it use a thread-local state : every thread must call simpleRNG_init() before generating numbers.
  * 
  * Dependencies :
  * - stdint.h (8, 32 and 64 bit types, both signed and unsigned)
+ * - unsigned __int128 (GCC/Clang)
+ * - math.h (binomial numbers, link with -lm)
  * 
  */
 
@@ -13,8 +18,79 @@
 #define INC_SIMPLERNG_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+/*---Enums---*/
+
+typedef enum
+{
+    SIMPLERNG_BACKEND_LCG,
+    SIMPLERNG_BACKEND_XOSHIRO256SS,
+    SIMPLERNG_BACKEND_PCG64,
+    SIMPLERNG_BACKEND_COUNT
+} simpleRNG_backend_t;
+
+/// Backend used by simpleRNG_init() and simpleRNG_init_r(), can be changed at compile time
+#ifndef SIMPLERNG_DEFAULT_BACKEND
+#define SIMPLERNG_DEFAULT_BACKEND SIMPLERNG_BACKEND_LCG
+#endif
+
+/*---Structs---*/
+
+typedef struct
+{
+    simpleRNG_backend_t backend;
+    union
+    {
+        uint64_t current_number; // LCG : current RNG number, used to generate the next one
+        uint64_t xoshiro[4];     // xoshiro256** : 256 bit state
+        struct
+        {
+            unsigned __int128 state;
+            unsigned __int128 increment; // must be odd
+        } pcg;                   // PCG64 : 128 bit LCG
+    };
+} simpleRNG_state_t;
+
+/*---Explicit state---*/
+
+bool simpleRNG_getBackendFromName(const char *name, simpleRNG_backend_t *backend_ptr);
+
+void simpleRNG_init_r(simpleRNG_state_t *state_ptr, uint64_t seed);
+void simpleRNG_initBackend_r(simpleRNG_state_t *state_ptr, simpleRNG_backend_t backend, uint64_t seed);
+bool simpleRNG_jump_r(simpleRNG_state_t *state_ptr, uint64_t step_count);
+void simpleRNG_jumpStream_r(simpleRNG_state_t *state_ptr);
+uint64_t simpleRNG_getStreamCount_r(const simpleRNG_state_t *state_ptr);
+bool simpleRNG_getDistance_r(const simpleRNG_state_t *from_ptr, const simpleRNG_state_t *to_ptr, uint64_t *distance_ptr);
+
+uint64_t simpleRNG_randomUint64_r(simpleRNG_state_t *state_ptr);
+uint32_t simpleRNG_randomUint32_r(simpleRNG_state_t *state_ptr);
+uint8_t simpleRNG_randomUint8_r(simpleRNG_state_t *state_ptr);
+int64_t simpleRNG_randomInt64_r(simpleRNG_state_t *state_ptr);
+int32_t simpleRNG_randomInt32_r(simpleRNG_state_t *state_ptr);
+int8_t simpleRNG_randomInt8_r(simpleRNG_state_t *state_ptr);
+
+uint64_t simpleRNG_randomUint64InRange_r(simpleRNG_state_t *state_ptr, uint64_t min_value, uint64_t max_value);
+uint32_t simpleRNG_randomUint32InRange_r(simpleRNG_state_t *state_ptr, uint32_t min_value, uint32_t max_value);
+uint8_t simpleRNG_randomUint8InRange_r(simpleRNG_state_t *state_ptr, uint8_t min_value, uint8_t max_value);
+int64_t simpleRNG_randomInt64InRange_r(simpleRNG_state_t *state_ptr, int64_t min_value, int64_t max_value);
+int32_t simpleRNG_randomInt32InRange_r(simpleRNG_state_t *state_ptr, int32_t min_value, int32_t max_value);
+int8_t simpleRNG_randomInt8InRange_r(simpleRNG_state_t *state_ptr, int8_t min_value, int8_t max_value);
+
+float simpleRNG_randomFloat_r(simpleRNG_state_t *state_ptr);
+double simpleRNG_randomDouble_r(simpleRNG_state_t *state_ptr);
+uint64_t simpleRNG_randomBinomial_r(simpleRNG_state_t *state_ptr, uint64_t trial_count, double probability);
+
+void simpleRNG_fillUint32InRange_r(simpleRNG_state_t *state_ptr, uint32_t *out, uint32_t count, uint32_t min_value, uint32_t max_value);
+
+/*---State of the calling thread---*/
+
+simpleRNG_state_t *simpleRNG_getState();
 
 void simpleRNG_init(uint64_t seed);
+void simpleRNG_initBackend(simpleRNG_backend_t backend, uint64_t seed);
+bool simpleRNG_jump(uint64_t step_count);
+void simpleRNG_jumpStream();
 
 uint64_t simpleRNG_randomUint64();
 uint32_t simpleRNG_randomUint32();
@@ -32,6 +108,9 @@ int8_t simpleRNG_randomInt8InRange(int8_t min_value, int8_t max_value);
 
 float simpleRNG_randomFloat();
 double simpleRNG_randomDouble();
+uint64_t simpleRNG_randomBinomial(uint64_t trial_count, double probability);
+
+void simpleRNG_fillUint32InRange(uint32_t *out, uint32_t count, uint32_t min_value, uint32_t max_value);
 
 
 #endif /* INC_SIMPLERNG_H */
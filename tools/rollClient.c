@@ -0,0 +1,189 @@
+/**
+ * @file rollClient.c
+ * @author Kezia Marcou
+ * @brief Small client for the roll daemon (roll --serve), to test it locally and measure its latency.
+ * 
+ * Usage : rollClient <socket path> [-n count] [formula ...]
+ * Every formula is sent count times, one request at a time, and the mean round trip time is printed on stderr.
+ * Without formulas, every line read on stdin is sent instead.
+ * 
+ */
+
+#define _GNU_SOURCE // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*******************************************
+ * Macros
+ */
+
+#define LINE_BUFFER_SIZE 4096
+
+/*******************************************
+ * Function prototypes
+ */
+
+int connectToServer(const char *socket_path);
+bool roll(int fd, const char *formula, char *result, size_t result_size);
+uint64_t getTimeNs();
+
+/********************************************
+ * Main
+ */
+
+int main(int argc, char *argv[])
+{
+    unsigned long roll_count = 1;
+    int first_formula = 2;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage : %s <socket path> [-n count] [formula ...]\n", argv[0]);
+        return 1;
+    }
+
+    if ((argc >= 4) && !strcmp(argv[2], "-n"))
+    {
+        roll_count = strtoul(argv[3], NULL, 10);
+        first_formula = 4;
+    }
+
+    int fd = connectToServer(argv[1]);
+    if (fd < 0)
+    {
+        perror("connect");
+        return 1;
+    }
+
+    char line[LINE_BUFFER_SIZE];
+    char result[LINE_BUFFER_SIZE];
+
+    // No formula : forward stdin
+    if (first_formula >= argc)
+    {
+        while (fgets(line, sizeof line, stdin) != NULL)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            if (!roll(fd, line, result, sizeof result))
+            {
+                close(fd);
+                return 1;
+            }
+            printf("%s\n", result);
+        }
+
+        close(fd);
+        return 0;
+    }
+
+    uint64_t total_time = 0;
+    uint64_t request_count = 0;
+
+    for (int i = first_formula; i < argc; i++)
+    {
+        for (unsigned long j = 0; j < roll_count; j++)
+        {
+            uint64_t start = getTimeNs();
+            if (!roll(fd, argv[i], result, sizeof result))
+            {
+                close(fd);
+                return 1;
+            }
+            total_time += getTimeNs() - start;
+            request_count++;
+
+            printf("%s\n", result);
+        }
+    }
+
+    fprintf(stderr, "%llu requests, mean round trip : %.1f us\n", (unsigned long long) request_count, (double) total_time / request_count / 1000.0);
+
+    close(fd);
+    return 0;
+}
+
+/********************************************************
+ * Functions
+ */
+
+/**
+ * Connect to the roll daemon. Returns -1 on error
+ * 
+ * @param socket_path 
+ */
+int connectToServer(const char *socket_path)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+    if (strlen(socket_path) >= sizeof address.sun_path)
+    {
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd >= 0) && (connect(fd, (struct sockaddr *) &address, sizeof address) != 0))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Send one formula and wait for its result line
+ * 
+ * @param fd 
+ * @param formula 
+ * @param result set to the result line, without the newline
+ * @param result_size 
+ */
+bool roll(int fd, const char *formula, char *result, size_t result_size)
+{
+    char request[LINE_BUFFER_SIZE + 1];
+    size_t length = strlen(formula);
+
+    if (length >= LINE_BUFFER_SIZE)
+    {
+        length = LINE_BUFFER_SIZE - 1;
+    }
+    memcpy(request, formula, length);
+    request[length] = '\n';
+
+    if (send(fd, request, length + 1, MSG_NOSIGNAL) != (ssize_t) (length + 1))
+    {
+        perror("send");
+        return false;
+    }
+
+    size_t received = 0;
+    while ((received == 0) || (result[received - 1] != '\n'))
+    {
+        ssize_t count = recv(fd, &result[received], result_size - received - 1, 0);
+        if (count <= 0)
+        {
+            fprintf(stderr, "Connection closed by the server\n");
+            return false;
+        }
+        received += count;
+    }
+
+    result[received - 1] = '\0';
+    return true;
+}
+
+uint64_t getTimeNs()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000ULL + time.tv_nsec;
+}